@@ -11,17 +11,36 @@ QT       -= gui
 TARGET = tst_avltree
 CONFIG   += console
 CONFIG   -= app_bundle
+CONFIG   += c++11
 
 QMAKE_CXXFLAGS += -Wall -Werror
+QMAKE_CXXFLAGS += -pthread
+LIBS += -pthread
 
 TEMPLATE = app
 
 
 SOURCES += \
     interval.cpp \
+    free_gap_avl_tree.cpp \
+    interval_set.cpp \
+    interval_tree.cpp \
     tst_avltree.cpp
 DEFINES += SRCDIR=\\\"$$PWD/\\\"
 
 HEADERS += \
     interval.h \
-    avl_tree.h
+    node_pool.h \
+    avl_tree.h \
+    compact_avl_tree.h \
+    find_cache.h \
+    mapped_storage.h \
+    range_lookup.h \
+    free_gap_avl_tree.h \
+    frozen_index.h \
+    interval_set.h \
+    interval_tree.h \
+    lazy_avl_tree.h \
+    sharded_avl_tree.h \
+    snapshot_avl_tree.h \
+    tree_stats.h
@@ -1,7 +1,20 @@
 #ifndef AVL_TREE_H
 #define AVL_TREE_H
 
+#include <cstddef>
+
+#include <cstdint>
+using std::uint32_t;
+using std::uint64_t;
+
 #include <cstdlib>
+#include <cstring>
+
+#include <fstream>
+#include <istream>
+#include <ostream>
+
+#include <new>
 
 #include <utility>
 using std::pair;
@@ -10,16 +23,101 @@ using std::make_pair;
 #include <limits>
 using std::numeric_limits;
 
+#include <memory>
+using std::shared_ptr;
+
 #include <algorithm>
 using std::max;
 
+#include <future>
+
+#include <iterator>
+
 #include <iostream>
 using std::cout;
 using std::endl;
 
+#include <thread>
+
+#include <type_traits>
+
+#include <vector>
+using std::vector;
+
+#include "node_pool.h"
+
+// Augmentation policy: every node carries an Augment::Summary of its
+// subtree, recomputed by update() whenever the node's height is, which
+// covers rotations too. ENABLED tells the tree whether summaries above the
+// point where rebalancing stops still have to be refreshed.
+template <typename T>
+struct No_Augment {
+    struct Summary {};
+    static const bool ENABLED = false;
+    static void update(Summary & summary, const T & value, const Summary * left, const Summary * right);
+};
+
+template <typename T>
+void No_Augment<T>::update(Summary &, const T &, const Summary *, const Summary *) {}
+
+enum Tree_Operation {
+    FIND_OPERATION,
+    INSERT_OPERATION,
+    REMOVE_OPERATION
+};
+
+enum Tree_Rotation {
+    RR_ROTATION,
+    LL_ROTATION,
+    LR_ROTATION,
+    RL_ROTATION
+};
+
+// Statistics policy: the tree reports every comparison made while
+// descending, every rebalancing rotation, every node created or destroyed,
+// and the depth each find, insert and remove reached. No_Stats ignores
+// them all, so the calls vanish once inlined. See tree_stats.h for a
+// policy that counts.
+struct No_Stats {
+    static void compared() {}
+    static void rotated(Tree_Rotation) {}
+    static void allocated(std::size_t) {}
+    static void freed(std::size_t) {}
+    static void descended(Tree_Operation, unsigned) {}
+};
+
+// Comparison policy: compare(a, b) is negative, zero or positive as a is
+// less than, equal to or greater than b, so a descent makes one comparison
+// per level. Three_Way_Compare calls a.compare(b) when T provides it, and
+// falls back to operator< then operator> otherwise.
+template <typename T>
+struct Three_Way_Compare {
+    static int compare(const T & a, const T & b);
+};
+
+template <typename T>
+auto __three_way_compare(const T & a, const T & b, int) -> decltype(int(a.compare(b)))
+{
+    return a.compare(b);
+}
+
+template <typename T>
+int __three_way_compare(const T & a, const T & b, long)
+{
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
 template <typename T>
+inline int Three_Way_Compare<T>::compare(const T &a, const T &b)
+{
+    return __three_way_compare(a, b, 0);
+}
+
+template <typename T, typename Allocator = allocator<T>, typename Augment = No_Augment<T>, typename Stats = No_Stats,
+          typename Compare = Three_Way_Compare<T> >
 class AVL_Tree
 {
+protected:
     class Node {
     public:
         enum Balance_Factor {
@@ -32,314 +130,1815 @@ class AVL_Tree
 
         Node * _left;
         Node * _right;
+        Node * _parent;
         T _value;
         unsigned _height;
+        unsigned _count;
+        typename Augment::Summary _summary;
 
         void __update_height();
-        const T __find(T value);
-        Node * __insert(T value);
+        void __update_count();
+        Node * __min();
         Node * __max();
+        Node * __next();
+        Node * __prev();
         Node * __balance();
         Node * __RR_rotate();
         Node * __LR_rotate();
         Node * __RL_rotate();
         Node * __LL_rotate();
 
-        Node(const T & value);
-        virtual ~Node();
+        template <typename... Args>
+        Node(Args &&... args);
         int __balance_factor() const;
 
         // debug
         void print_node(int offset = 0);
     };
 
+    // An AVL tree holding fewer than 2^31 nodes is at most 45 levels deep.
+    static const int MAX_HEIGHT = 64;
+    // Smallest subtree the set operations hand to another thread.
+    static const unsigned PARALLEL_GRAIN = 1 << 14;
+    // "AVLT" as read on a little-endian host; a file saved with the other
+    // byte order fails the magic check.
+    static const uint32_t FILE_MAGIC = 0x544c5641;
+    static const uint32_t FILE_VERSION = 1;
+    static const uint64_t CHECKSUM_SEED = 14695981039346656037ULL;
+    static const std::size_t IO_BUFFER = 1 << 16;
+
+    typedef Node_Pool<Node, Allocator> Pool;
+
     int _size;
     Node * _root;
-    Node *__remove(Node * root, const T &position, T & removed);
+    shared_ptr<Pool> _pool;
+    // Bumped whenever nodes are freed or leave the tree, see epoch().
+    unsigned long _epoch;
+    AVL_Tree(Node * root, const shared_ptr<Pool> & pool);
+    Pool & __pool();
+    template <typename... Args>
+    Node * __create(Args &&... args);
+    Node ** __insertion_link(const T & value, Node ** path[], int & depth);
+    Node ** __hinted_link(Node * hint, const T & value, Node *& parent);
+    void __link(Node ** link, Node * node, Node ** path[], int depth);
+    Node * __unlink(const T & value);
+    void __retrace(Node ** path[], int depth);
+    void __retrace_from(Node * node);
+    unsigned __count_less(const T & value) const;
+    unsigned __count_not_greater(const T & value) const;
+    template <typename Forward_Iterator>
+    Node * __build(Forward_Iterator & first, std::size_t count);
+    Node * __join(Node * left, Node * middle, Node * right);
+    Node * __join_right(Node * left, Node * middle, Node * right);
+    Node * __join_left(Node * left, Node * middle, Node * right);
+    Node * __join(Node * left, Node * right);
+    Node * __remove_min(Node * root, Node *& min);
+    void __split(Node * root, const T & key, Node *& left, Node *& right);
+    void __split3(Node * root, const T & key, Node *& left, vector<Node *> & middle, Node *& right);
+    void __adopt_pool(AVL_Tree & other);
+    Node * __union(Node * mine, Node * theirs, vector<Node *> & dropped, int spawn);
+    Node * __intersect(Node * mine, const Node * theirs, vector<Node *> & scratch, int spawn);
+    Node * __subtract(Node * mine, const Node * theirs, vector<Node *> & dropped, int spawn);
+    void __collect(Node * root, vector<Node *> & nodes);
+    void __finish_set_operation(Node * root, const vector<Node *> & dropped);
+    static int __spawn_depth();
+    Node * __insert_batch(Node * root, const std::size_t * first, const std::size_t * last, const T * const * values, char * inserted);
+    Node * __remove_batch(Node * root, const std::size_t * first, const std::size_t * last, const T * const * values, char * removed);
+    static void __partition(const T & value, const std::size_t * first, const std::size_t * last, const T * const * values,
+                            const std::size_t *& less_end, const std::size_t *& greater_begin);
+    static vector<std::size_t> __strictly_increasing(const vector<const T *> & values);
+    static uint64_t __checksum(uint64_t hash, const char * bytes, std::size_t size);
+    void __destroy(Node * node);
+    void __destroy_subtree(Node * root);
+    void __deallocate_subtree(Node * root);
+    static unsigned __height(const Node * node);
+    static unsigned __count(const Node * node);
+    static int __compare(const T & a, const T & b);
+
+public:
+    class const_iterator {
+        friend class AVL_Tree;
+        Node * _node;
+        const AVL_Tree * _tree;
+        const_iterator(Node * node, const AVL_Tree * tree);
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T * pointer;
+        typedef const T & reference;
+
+        const_iterator();
+        reference operator*() const;
+        pointer operator->() const;
+        const_iterator & operator++();
+        const_iterator operator++(int);
+        const_iterator & operator--();
+        const_iterator operator--(int);
+        bool operator==(const const_iterator & o) const;
+        bool operator!=(const const_iterator & o) const;
+    };
+    typedef const_iterator iterator;
+
+protected:
+    const_iterator __iterator(Node * node) const;
 
 public:
-    AVL_Tree();
+    explicit AVL_Tree(const Allocator & allocator = Allocator());
     virtual ~AVL_Tree();
 
+    AVL_Tree(AVL_Tree && o);
+    AVL_Tree & operator=(AVL_Tree && o);
+
+    AVL_Tree(const AVL_Tree &) = delete;
+    AVL_Tree & operator=(const AVL_Tree &) = delete;
+
     bool empty();
     bool insert(const T & value);
+    bool insert(T && value);
+    template <typename... Args>
+    bool emplace(Args &&... args);
+    const_iterator insert(const_iterator hint, const T & value);
+    const_iterator insert(const_iterator hint, T && value);
+    template <typename Forward_Iterator>
+    bool assign(Forward_Iterator first, Forward_Iterator last);
+    template <typename Random_Access_Iterator, typename Output_Iterator>
+    unsigned insert_batch(Random_Access_Iterator first, Random_Access_Iterator last, Output_Iterator inserted);
+    template <typename Random_Access_Iterator, typename Output_Iterator>
+    unsigned remove_batch(Random_Access_Iterator first, Random_Access_Iterator last, Output_Iterator removed);
+    void clear();
     bool check(const T & value);
 
-    unsigned size();
+    bool save(std::ostream & out) const;
+    bool save(const char * path) const;
+    bool load(std::istream & in);
+    bool load(const char * path);
+
+    AVL_Tree split(const T & key);
+    bool join(AVL_Tree & right);
+
+    void union_with(AVL_Tree & other);
+    void intersect_with(const AVL_Tree & other);
+    void subtract(const AVL_Tree & other);
 
-    const T root();
-    const T find(const T & value);
-    const T remove(const T &value);
+    unsigned size() const;
+    std::size_t memory_usage() const;
+    unsigned long epoch() const;
+
+    const T * root() const;
+    const_iterator find(const T & value) const;
+    template <typename Key_Compare>
+    const_iterator find_by(Key_Compare key) const;
+    bool remove(const T & value);
+    bool extract(const T & value, T & removed);
+
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_iterator lower_bound(const T & value) const;
+    const_iterator upper_bound(const T & value) const;
+    template <typename Key_Compare>
+    const_iterator lower_bound_by(Key_Compare key) const;
+    template <typename Function>
+    void for_each_in_range(const T & low, const T & high, Function f) const;
+
+    const_iterator select(unsigned index) const;
+    unsigned rank(const T & value) const;
+    unsigned count_in_range(const T & low, const T & high) const;
 
     void print_tree();
 };
 
 // TREE
-template <typename T>
-AVL_Tree<T>::AVL_Tree(): _size(0), _root(NULL) {}
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+AVL_Tree<T, Allocator, Augment, Stats, Compare>::AVL_Tree(const Allocator &allocator):
+    _size(0), _root(NULL), _pool(std::allocate_shared<Pool>(allocator, allocator)), _epoch(0) {}
 
-template <typename T>
-AVL_Tree<T>::~AVL_Tree()
+// The moved-from tree is left empty, sharing the node pool.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+AVL_Tree<T, Allocator, Augment, Stats, Compare>::AVL_Tree(AVL_Tree &&o): _size(o._size), _root(o._root), _pool(o._pool), _epoch(0)
 {
-    if(_root != NULL)
-        delete _root;
+    __pool().share();
+    o._root = NULL;
+    o._size = 0;
+    o._epoch++;
 }
 
-template <typename T>
-bool AVL_Tree<T>::empty()
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+AVL_Tree<T, Allocator, Augment, Stats, Compare> &AVL_Tree<T, Allocator, Augment, Stats, Compare>::operator=(AVL_Tree &&o)
+{
+    if(this != &o)
+    {
+        clear();
+        _root = o._root;
+        _size = o._size;
+        _pool = o._pool;
+        __pool().share();
+        o._root = NULL;
+        o._size = 0;
+        o._epoch++;
+    }
+    return *this;
+}
+
+// The pool hands its blocks back all at once, so nodes only need to be
+// visited when T has a destructor to run.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+AVL_Tree<T, Allocator, Augment, Stats, Compare>::~AVL_Tree()
+{
+    clear();
+}
+
+// A pool shared with other trees, after split() or a move, keeps its
+// blocks: the nodes are handed back one by one instead.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::clear()
+{
+    Pool & pool = __pool();
+    if(_pool.use_count() > 1)
+        __deallocate_subtree(_root);
+    else
+    {
+        if(!std::is_trivially_destructible<T>::value)
+            __destroy_subtree(_root);
+        pool.release();
+    }
+    Stats::freed(_size);
+    _root = NULL;
+    _size = 0;
+    _epoch++;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+bool AVL_Tree<T, Allocator, Augment, Stats, Compare>::empty()
 {
     return _size == 0;
 }
 
-template <typename T>
-bool AVL_Tree<T>::insert(const T &value)
+// Descends once, recording the links it follows, then rebalances bottom-up
+// only while subtree heights keep changing.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+bool AVL_Tree<T, Allocator, Augment, Stats, Compare>::insert(const T &value)
 {
-    if(_root == NULL)
+    Node ** path[MAX_HEIGHT];
+    int depth = 0;
+    Node ** link = __insertion_link(value, path, depth);
+    if(link == NULL)
+        return false;
+    __link(link, __create(value), path, depth);
+    return true;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+bool AVL_Tree<T, Allocator, Augment, Stats, Compare>::insert(T &&value)
+{
+    Node ** path[MAX_HEIGHT];
+    int depth = 0;
+    Node ** link = __insertion_link(value, path, depth);
+    if(link == NULL)
+        return false;
+    __link(link, __create(std::move(value)), path, depth);
+    return true;
+}
+
+// Inserts value as close as possible to hint, in the manner of
+// std::set::insert(hint). Returns the new element, or the stored element
+// equal to value, which is left as it is. Feeding the result back as the next hint makes a
+// finger for streams in nearly sorted order: the search starts where the
+// last element went instead of at the root. Rebalancing and the subtree
+// counts on the way up cost what they do for insert().
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator AVL_Tree<T, Allocator, Augment, Stats, Compare>::insert(const_iterator hint, const T &value)
+{
+    Node * parent;
+    Node ** link = __hinted_link(hint._node, value, parent);
+    if(link == NULL)
+        return const_iterator(parent, this);
+    Node * node = __create(value);
+    *link = node;
+    node->_parent = parent;
+    _size++;
+    __retrace_from(parent);
+    return const_iterator(node, this);
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator AVL_Tree<T, Allocator, Augment, Stats, Compare>::insert(const_iterator hint, T &&value)
+{
+    Node * parent;
+    Node ** link = __hinted_link(hint._node, value, parent);
+    if(link == NULL)
+        return const_iterator(parent, this);
+    Node * node = __create(std::move(value));
+    *link = node;
+    node->_parent = parent;
+    _size++;
+    __retrace_from(parent);
+    return const_iterator(node, this);
+}
+
+// Builds the element in a new node from args, then links it in. The node
+// is given back if an equal element is already stored.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+template <typename... Args>
+bool AVL_Tree<T, Allocator, Augment, Stats, Compare>::emplace(Args &&... args)
+{
+    Node * node = __create(std::forward<Args>(args)...);
+    Node ** path[MAX_HEIGHT];
+    int depth = 0;
+    Node ** link = __insertion_link(node->_value, path, depth);
+    if(link == NULL)
     {
-        _root = new Node(value);
-        _size++;
-        return true;
+        __destroy(node);
+        return false;
     }
-    Node * root_of_subtree = _root->__insert(value);
-    if(root_of_subtree != NULL)
+    __link(link, node, path, depth);
+    return true;
+}
+
+// Replaces the contents of the tree with [first, last), which must be sorted
+// and free of equal (overlapping) elements. The range is walked once to
+// validate it and once more to build a perfectly balanced tree, so the cost
+// is linear. Returns false and leaves the tree untouched otherwise.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+template <typename Forward_Iterator>
+bool AVL_Tree<T, Allocator, Augment, Stats, Compare>::assign(Forward_Iterator first, Forward_Iterator last)
+{
+    std::size_t count = 0;
+    if(first != last)
     {
-        _root = root_of_subtree;
-        _size++;
-        return true;
+        Forward_Iterator previous = first;
+        Forward_Iterator current = first;
+        for(count = 1, ++current; current != last; ++previous, ++current, ++count)
+            if(Compare::compare(*previous, *current) >= 0)
+                return false;
     }
-    return false;
+    clear();
+    _root = __build(first, count);
+    _size = count;
+    return true;
 }
 
-template <typename T>
-const T AVL_Tree<T>::remove(const T & value)
+// Binary snapshot: a header of FILE_MAGIC, FILE_VERSION, sizeof(T) and the
+// element count, the elements in order as raw bytes, then an FNV-1a
+// checksum of those bytes. T must be trivially copyable, and the file is
+// only readable on a host of the same byte order.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+bool AVL_Tree<T, Allocator, Augment, Stats, Compare>::save(std::ostream &out) const
+{
+    static_assert(std::is_trivially_copyable<T>::value, "save needs a trivially copyable T");
+    const uint32_t header[3] = { FILE_MAGIC, FILE_VERSION, uint32_t(sizeof(T)) };
+    const uint64_t count = _size;
+    out.write(reinterpret_cast<const char *>(header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    uint64_t checksum = CHECKSUM_SEED;
+    vector<char> buffer;
+    buffer.reserve(IO_BUFFER + sizeof(T));
+    for(const_iterator it = begin(); it != end(); ++it)
+    {
+        const char * bytes = reinterpret_cast<const char *>(&*it);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+        if(buffer.size() >= IO_BUFFER)
+        {
+            checksum = __checksum(checksum, buffer.data(), buffer.size());
+            out.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+    checksum = __checksum(checksum, buffer.data(), buffer.size());
+    out.write(buffer.data(), buffer.size());
+    out.write(reinterpret_cast<const char *>(&checksum), sizeof(checksum));
+    return bool(out);
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+bool AVL_Tree<T, Allocator, Augment, Stats, Compare>::save(const char *path) const
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if(!save(out))
+        return false;
+    out.close();
+    return !out.fail();
+}
+
+// Reads a snapshot written by save() and rebuilds the tree from it in O(n)
+// through assign(). On a bad header, a short read, a checksum mismatch or
+// elements out of order it returns false and leaves the tree as it was.
+// The payload is read in IO_BUFFER steps, so a corrupt count fails at the
+// end of the stream instead of reserving its size up front.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+bool AVL_Tree<T, Allocator, Augment, Stats, Compare>::load(std::istream &in)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "load needs a trivially copyable T");
+    static_assert(alignof(T) <= alignof(std::max_align_t), "load reads T from a byte buffer");
+    uint32_t header[3];
+    uint64_t count;
+    if(!in.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+       header[0] != FILE_MAGIC || header[1] != FILE_VERSION || header[2] != sizeof(T))
+        return false;
+    if(!in.read(reinterpret_cast<char *>(&count), sizeof(count)) || count > uint64_t(numeric_limits<int>::max()))
+        return false;
+    const std::size_t size = std::size_t(count) * sizeof(T);
+    vector<char> bytes;
+    while(bytes.size() < size)
+    {
+        std::size_t done = bytes.size();
+        bytes.resize(size - done < IO_BUFFER ? size : done + IO_BUFFER);
+        if(!in.read(&bytes[done], bytes.size() - done))
+            return false;
+    }
+    uint64_t checksum;
+    if(!in.read(reinterpret_cast<char *>(&checksum), sizeof(checksum)) ||
+       checksum != __checksum(CHECKSUM_SEED, bytes.data(), bytes.size()))
+        return false;
+    const T * values = reinterpret_cast<const T *>(bytes.data());
+    return assign(values, values + count);
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+bool AVL_Tree<T, Allocator, Augment, Stats, Compare>::load(const char *path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return load(in);
+}
+
+// Inserts a sorted batch in one pass over the tree: the batch is split
+// around each subtree root, both halves go down their own side, and the
+// results are joined back under the root. That is O(m log(n/m + 1)) for m
+// elements instead of O(m log n), with each touched subtree rebalanced
+// once. inserted receives, in batch order, what insert() would have
+// returned for every element; an element overlapping an earlier one of the
+// batch, or out of order, is refused.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+template <typename Random_Access_Iterator, typename Output_Iterator>
+unsigned AVL_Tree<T, Allocator, Augment, Stats, Compare>::insert_batch(Random_Access_Iterator first, Random_Access_Iterator last, Output_Iterator inserted)
+{
+    vector<const T *> values;
+    values.reserve(last - first);
+    for(Random_Access_Iterator it = first; it != last; ++it)
+        values.push_back(&*it);
+    const vector<std::size_t> batch = __strictly_increasing(values);
+    vector<char> flags(values.size(), 0);
+    if(!batch.empty())
+        _root = __insert_batch(_root, &batch[0], &batch[0] + batch.size(), &values[0], &flags[0]);
+    unsigned count = 0;
+    for(std::size_t i = 0; i < flags.size(); i++)
+    {
+        *inserted++ = flags[i] != 0;
+        count += flags[i];
+    }
+    _size += count;
+    return count;
+}
+
+// Removes, in one pass, the element matching each query of a sorted batch,
+// the same way insert_batch merges. removed receives, in batch order,
+// whether each query removed an element, as calling remove() for each in
+// turn would: a stored element matched by several queries is removed by
+// the first of them, and the later ones go on to match other elements.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+template <typename Random_Access_Iterator, typename Output_Iterator>
+unsigned AVL_Tree<T, Allocator, Augment, Stats, Compare>::remove_batch(Random_Access_Iterator first, Random_Access_Iterator last, Output_Iterator removed)
+{
+    vector<const T *> values;
+    values.reserve(last - first);
+    for(Random_Access_Iterator it = first; it != last; ++it)
+        values.push_back(&*it);
+    const vector<std::size_t> batch = __strictly_increasing(values);
+    vector<char> flags(values.size(), 0);
+    if(!batch.empty())
+        _root = __remove_batch(_root, &batch[0], &batch[0] + batch.size(), &values[0], &flags[0]);
+    unsigned count = 0;
+    for(std::size_t i = 0; i < flags.size(); i++)
+    {
+        *removed++ = flags[i] != 0;
+        count += flags[i];
+    }
+    _size -= count;
+    return count;
+}
+
+// Element the key matches, or end(), for looking up by something other
+// than a T: key(value) is negative, zero or positive as the key sorts
+// before, matches or sorts after value, in the tree's order.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+template <typename Key_Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator AVL_Tree<T, Allocator, Augment, Stats, Compare>::find_by(Key_Compare key) const
+{
+    unsigned depth = 0;
+    Node * node = _root;
+    while(node != NULL)
+    {
+        depth++;
+        Stats::compared();
+        int order = key(node->_value);
+        if(order < 0)
+            node = node->_left;
+        else if(order > 0)
+            node = node->_right;
+        else
+        {
+            Stats::descended(FIND_OPERATION, depth);
+            return const_iterator(node, this);
+        }
+    }
+    Stats::descended(FIND_OPERATION, depth);
+    return end();
+}
+
+// Returns false if no element is equal to value.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+bool AVL_Tree<T, Allocator, Augment, Stats, Compare>::remove(const T & value)
+{
+    Node * node = __unlink(value);
+    if(node == NULL)
+        return false;
+    __destroy(node);
+    return true;
+}
+
+// Like remove, moving the element out into removed.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+bool AVL_Tree<T, Allocator, Augment, Stats, Compare>::extract(const T & value, T & removed)
 {
-    T removed = T::invalid();
-    _root = __remove(_root, value, removed);
+    Node * node = __unlink(value);
+    if(node == NULL)
+        return false;
+    removed = std::move(node->_value);
+    __destroy(node);
+    return true;
+}
+
+// Takes the node equal to value out of the tree and rebalances, without
+// destroying it. A node with two children is replaced by relinking its
+// successor in its place, so no value is copied and no second descent is
+// needed.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::__unlink(const T & value)
+{
+    Node ** path[MAX_HEIGHT];
+    int depth = 0;
+    Node ** link = &_root;
+    while(*link != NULL)
+    {
+        Node * node = *link;
+        Node ** next;
+        int order = __compare(value, node->_value);
+        if(order < 0)
+            next = &node->_left;
+        else if(order > 0)
+            next = &node->_right;
+        else
+            break;
+        path[depth++] = link;
+        link = next;
+    }
+    if(*link == NULL)
+    {
+        Stats::descended(REMOVE_OPERATION, depth);
+        return NULL;
+    }
+    Stats::descended(REMOVE_OPERATION, depth + 1);
+
+    Node * removed = *link;
+    if(removed->_right == NULL)
+    {
+        *link = removed->_left;
+        if(removed->_left != NULL)
+            removed->_left->_parent = removed->_parent;
+    }
+    else
+    {
+        int removed_depth = depth;
+        path[depth++] = link;
+        Node ** successor_link = &removed->_right;
+        while((*successor_link)->_left != NULL)
+        {
+            path[depth++] = successor_link;
+            successor_link = &(*successor_link)->_left;
+        }
+        Node * successor = *successor_link;
+        *successor_link = successor->_right;
+        if(successor->_right != NULL)
+            successor->_right->_parent = successor->_parent;
+        successor->_left = removed->_left;
+        successor->_right = removed->_right;
+        successor->_parent = removed->_parent;
+        successor->_height = removed->_height;
+        if(successor->_left != NULL)
+            successor->_left->_parent = successor;
+        if(successor->_right != NULL)
+            successor->_right->_parent = successor;
+        *link = successor;
+        if(removed_depth + 1 < depth)
+            path[removed_depth + 1] = &successor->_right;
+    }
+    _size--;
+    __retrace(path, depth);
     return removed;
 }
 
-template <typename T>
-unsigned AVL_Tree<T>::size()
+// Moves every element not less than key into the returned tree, keeping
+// the smaller ones; an interval overlapping key goes to the returned tree.
+// Subtrees are cut along the search path for key and joined back on each
+// side, which costs O(log n) and neither copies nor allocates nodes. Both
+// trees share one node pool from then on, which locks while it is shared,
+// so each tree can be handed to its own thread. Joining them back, or
+// any tree sharing their pool, needs both out of the other threads' hands.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+AVL_Tree<T, Allocator, Augment, Stats, Compare> AVL_Tree<T, Allocator, Augment, Stats, Compare>::split(const T & key)
+{
+    Node * left;
+    Node * right;
+    __pool().share();
+    __split(_root, key, left, right);
+    _root = left;
+    _size = left == NULL ? 0 : left->_count;
+    _epoch++;
+    return AVL_Tree(right, _pool);
+}
+
+// Appends the elements of right, which must all be greater than those of
+// this tree, in O(log n), leaving right empty. right's node pool is merged
+// into this one. Returns false and changes nothing if the trees are not
+// ordered that way.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+bool AVL_Tree<T, Allocator, Augment, Stats, Compare>::join(AVL_Tree &right)
+{
+    if(this == &right)
+        return false;
+    if(_root != NULL && right._root != NULL && Compare::compare(_root->__max()->_value, right._root->__min()->_value) >= 0)
+        return false;
+    __adopt_pool(right);
+    _root = __join(_root, right._root);
+    _size += right._size;
+    right._root = NULL;
+    right._size = 0;
+    right._epoch++;
+    return true;
+}
+
+// The set operations below treat overlapping intervals as equal, and
+// recurse on the structure of both trees: the pivot tree's root splits the
+// other tree, and both halves are solved independently, in parallel for
+// large subtrees, then joined back. That is O(m log(n/m + 1)) work for
+// trees of sizes m <= n. Nodes are relinked, never copied, and the node
+// pool is only touched once the parallel part is over.
+
+// Adds the elements of other that overlap none of this tree, leaving other
+// empty. Elements of this tree win over the ones of other they overlap,
+// which are dropped.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::union_with(AVL_Tree &other)
+{
+    if(this == &other)
+        return;
+    __adopt_pool(other);
+    vector<Node *> dropped;
+    Node * root = __union(_root, other._root, dropped, __spawn_depth());
+    other._root = NULL;
+    other._size = 0;
+    other._epoch++;
+    __finish_set_operation(root, dropped);
+}
+
+// Keeps only the elements overlapping some element of other.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::intersect_with(const AVL_Tree &other)
+{
+    if(this == &other)
+        return;
+    vector<Node *> scratch;
+    Node * root = __intersect(_root, other._root, scratch, __spawn_depth());
+    __finish_set_operation(root, scratch);
+}
+
+// Removes every element overlapping some element of other.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::subtract(const AVL_Tree &other)
+{
+    if(this == &other)
+    {
+        clear();
+        return;
+    }
+    vector<Node *> dropped;
+    Node * root = __subtract(_root, other._root, dropped, __spawn_depth());
+    __finish_set_operation(root, dropped);
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+unsigned AVL_Tree<T, Allocator, Augment, Stats, Compare>::size() const
 {
     return _size;
 }
 
-template <typename T>
-const T AVL_Tree<T>::root()
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+std::size_t AVL_Tree<T, Allocator, Augment, Stats, Compare>::memory_usage() const
+{
+    const Pool * pool = _pool.get();
+    while(pool->forward())
+        pool = pool->forward().get();
+    return pool->memory_usage();
+}
+
+// Changes whenever a node may have been freed or moved to another tree.
+// Inserting and rebalancing leave every node where it was, so a position
+// found earlier stays valid as long as the epoch is the same.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+unsigned long AVL_Tree<T, Allocator, Augment, Stats, Compare>::epoch() const
+{
+    return _epoch;
+}
+
+// NULL when the tree is empty.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+const T *AVL_Tree<T, Allocator, Augment, Stats, Compare>::root() const
 {
     if(_root == NULL)
-        return T::invalid();
-    return _root->_value;
+        return NULL;
+    return &_root->_value;
 }
 
-template <typename T>
-const T AVL_Tree<T>::find(const T & value)
+// The stored element equal to value, or end().
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator AVL_Tree<T, Allocator, Augment, Stats, Compare>::find(const T & value) const
 {
-    if(_root != NULL)
-        return _root->__find(value);
-    return T::invalid();
+    unsigned depth = 0;
+    Node * node = _root;
+    while(node != NULL)
+    {
+        depth++;
+        int order = __compare(value, node->_value);
+        if(order < 0)
+            node = node->_left;
+        else if(order > 0)
+            node = node->_right;
+        else
+        {
+            Stats::descended(FIND_OPERATION, depth);
+            return const_iterator(node, this);
+        }
+    }
+    Stats::descended(FIND_OPERATION, depth);
+    return end();
 }
 
-template <typename T>
-void AVL_Tree<T>::print_tree()
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+bool AVL_Tree<T, Allocator, Augment, Stats, Compare>::check(const T & value)
+{
+    Node * node = _root;
+    while(node != NULL)
+    {
+        int order = __compare(value, node->_value);
+        if(order < 0)
+            node = node->_left;
+        else if(order > 0)
+            node = node->_right;
+        else
+            return true;
+    }
+    return false;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator AVL_Tree<T, Allocator, Augment, Stats, Compare>::begin() const
 {
-    cout << "Tree: " << endl;
     if(_root == NULL)
-        cout << "NULL" << endl;
-    else
-        _root->print_node();
+        return end();
+    return const_iterator(_root->__min(), this);
 }
 
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator AVL_Tree<T, Allocator, Augment, Stats, Compare>::end() const
+{
+    return const_iterator(NULL, this);
+}
 
-template <typename T>
-typename AVL_Tree<T>::Node *AVL_Tree<T>::__remove(AVL_Tree::Node *root, const T & value, T &removed)
+// First element that is not less than value. For intervals, that is the
+// first one overlapping value or lying after it.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator AVL_Tree<T, Allocator, Augment, Stats, Compare>::lower_bound(const T & value) const
 {
-    if(root == NULL)
-        return NULL;
+    Node * node = _root;
+    Node * bound = NULL;
+    while(node != NULL)
+    {
+        if(Compare::compare(node->_value, value) < 0)
+            node = node->_right;
+        else
+        {
+            bound = node;
+            node = node->_left;
+        }
+    }
+    return const_iterator(bound, this);
+}
 
-    if(value == root->_value)
+// First element that is greater than value.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator AVL_Tree<T, Allocator, Augment, Stats, Compare>::upper_bound(const T & value) const
+{
+    Node * node = _root;
+    Node * bound = NULL;
+    while(node != NULL)
     {
-        if(removed.sameAs(T::invalid()))
-            removed = root->_value;
-        if(root->_right == NULL)
+        if(Compare::compare(value, node->_value) < 0)
         {
-            Node * temp = root;
-            root = root->_left;
-            delete temp;
-            _size--;
-            return root;
+            bound = node;
+            node = node->_left;
         }
+        else
+            node = node->_right;
+    }
+    return const_iterator(bound, this);
+}
+
+// First element the key does not sort after, with key as in find_by().
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+template <typename Key_Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator AVL_Tree<T, Allocator, Augment, Stats, Compare>::lower_bound_by(Key_Compare key) const
+{
+    Node * node = _root;
+    Node * bound = NULL;
+    while(node != NULL)
+    {
+        if(key(node->_value) > 0)
+            node = node->_right;
         else
         {
-            Node * temp = root->_right;
-            while(temp->_left != NULL)
-                temp = temp->_left;
-            root->_value = temp->_value;
-            root->_right = __remove(root->_right, temp->_value, removed);
+            bound = node;
+            node = node->_left;
         }
-    } else if(value < root->_value)
-        root->_left = __remove(root->_left, value, removed);
-    else if(value > root->_value)
-        root->_right = __remove(root->_right, value, removed);
+    }
+    return const_iterator(bound, this);
+}
 
-    root->__update_height();
-    root = root->__balance();
+// Calls f on every element between low and high, bounds included: one
+// descent to find the first element, then in-order steps, which cost
+// O(log n + k) overall.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+template <typename Function>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::for_each_in_range(const T & low, const T & high, Function f) const
+{
+    for(const_iterator it = lower_bound(low); it != end() && Compare::compare(high, *it) >= 0; ++it)
+        f(*it);
+}
 
-    return root;
+// Element at position index in sorted order, or end().
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator AVL_Tree<T, Allocator, Augment, Stats, Compare>::select(unsigned index) const
+{
+    Node * node = _root;
+    while(node != NULL)
+    {
+        unsigned left_count = node->_left == NULL ? 0 : node->_left->_count;
+        if(index < left_count)
+            node = node->_left;
+        else if(index > left_count)
+        {
+            index -= left_count + 1;
+            node = node->_right;
+        }
+        else
+            break;
+    }
+    return const_iterator(node, this);
 }
 
+// Number of elements less than value, which is also the position of
+// lower_bound(value).
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+unsigned AVL_Tree<T, Allocator, Augment, Stats, Compare>::rank(const T & value) const
+{
+    return __count_less(value);
+}
 
-// NODE
-template <typename T>
-void AVL_Tree<T>::Node::__update_height()
+// Number of elements between low and high, bounds included, as visited by
+// for_each_in_range.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+unsigned AVL_Tree<T, Allocator, Augment, Stats, Compare>::count_in_range(const T & low, const T & high) const
 {
+    unsigned not_greater = __count_not_greater(high);
+    unsigned less = __count_less(low);
+    return not_greater > less ? not_greater - less : 0;
+}
 
-    if(_left == NULL && _right == NULL)
-        _height = 1;
-    else if(_left == NULL)
-        _height = _right->_height + 1;
-    else if(_right == NULL)
-        _height = _left->_height + 1;
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::print_tree()
+{
+    cout << "Tree: " << endl;
+    if(_root == NULL)
+        cout << "NULL" << endl;
     else
-        _height = max(_right->_height, _left->_height) + 1;
+        _root->print_node();
+}
+
 
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+AVL_Tree<T, Allocator, Augment, Stats, Compare>::AVL_Tree(Node *root, const shared_ptr<Pool> &pool):
+    _size(root == NULL ? 0 : root->_count), _root(root), _pool(pool), _epoch(0) {}
+
+// The pool holding this tree's nodes, following it to the pool it was
+// merged into if another tree joined it.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Pool &AVL_Tree<T, Allocator, Augment, Stats, Compare>::__pool()
+{
+    while(_pool->forward())
+        _pool = _pool->forward();
+    if(_pool.use_count() == 1)
+        _pool->unshare();
+    return *_pool;
 }
 
-template <typename T>
-const T AVL_Tree<T>::Node::__find(T value)
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+template <typename... Args>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::__create(Args &&... args)
 {
-    if(value == _value)
-        return _value;
-    if(value < _value)
-    {
-        if(_left)
-            return _left->__find(value);
-    } else if(value > _value)
+    Stats::allocated(1);
+    return new (__pool().allocate()) Node(std::forward<Args>(args)...);
+}
+
+// Link where value belongs, with the links followed to get there in
+// path[0..depth), or NULL if an equal element is stored.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node **AVL_Tree<T, Allocator, Augment, Stats, Compare>::__insertion_link(const T &value, Node **path[], int &depth)
+{
+    Node ** link = &_root;
+    while(*link != NULL)
     {
-        if(_right)
-            return _right->__find(value);
+        Node * node = *link;
+        path[depth++] = link;
+        int order = __compare(value, node->_value);
+        if(order < 0)
+            link = &node->_left;
+        else if(order > 0)
+            link = &node->_right;
+        else
+        {
+            Stats::descended(INSERT_OPERATION, depth);
+            return NULL;
+        }
     }
-    return T::invalid();
+    Stats::descended(INSERT_OPERATION, depth);
+    return link;
 }
 
-template <typename T>
-typename AVL_Tree<T>::Node *AVL_Tree<T>::Node::__insert(T value)
+// Finger search from hint, or from the largest element for end(). Going
+// up from hint on value's side, the first ancestor reached from the other
+// side bounds hint's subtree; value lies before that bound only if it
+// belongs below hint. Otherwise the bound becomes the new hint. The
+// descent then starts from hint, so an element going next to hint costs
+// one or two comparisons, and one d positions away O(log d). Returns the
+// link with its node in parent, or NULL with the equal element in parent
+// if one is stored. The depth given to Stats is the number of nodes
+// compared, which is what the descent cost from the finger.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node **AVL_Tree<T, Allocator, Augment, Stats, Compare>::__hinted_link(Node *hint, const T &value, Node *&parent)
 {
-    if(value == _value)
+    parent = NULL;
+    if(hint == NULL && _root != NULL)
+        hint = _root->__max();
+    if(hint == NULL)
+    {
+        Stats::descended(INSERT_OPERATION, 0);
+        return &_root;
+    }
+    unsigned depth = 1;
+    int order = __compare(value, hint->_value);
+    if(order == 0)
+    {
+        Stats::descended(INSERT_OPERATION, depth);
+        parent = hint;
         return NULL;
-    if(value < _value)
+    }
+    while(true)
     {
-        if(_left != NULL)
+        Node * child = hint;
+        Node * bound = hint->_parent;
+        while(bound != NULL && (order > 0 ? bound->_right : bound->_left) == child)
         {
-            _left = _left->__insert(value);
-            if(_left == NULL)
-                return NULL;
+            child = bound;
+            bound = bound->_parent;
         }
-        else
-            _left = new Node(value);
+        if(bound == NULL)
+            break;
+        depth++;
+        int bound_order = __compare(value, bound->_value);
+        if(bound_order == 0)
+        {
+            Stats::descended(INSERT_OPERATION, depth);
+            parent = bound;
+            return NULL;
+        }
+        if((bound_order > 0) != (order > 0))
+            break;
+        hint = bound;
     }
-    else if(value > _value)
+    parent = hint;
+    Node ** link = order > 0 ? &hint->_right : &hint->_left;
+    while(*link != NULL)
     {
-        if(_right != NULL)
+        parent = *link;
+        depth++;
+        order = __compare(value, parent->_value);
+        if(order == 0)
         {
-            _right = _right->__insert(value);
-            if(_right == NULL)
-                return NULL;
+            Stats::descended(INSERT_OPERATION, depth);
+            return NULL;
         }
+        link = order < 0 ? &parent->_left : &parent->_right;
+    }
+    Stats::descended(INSERT_OPERATION, depth);
+    return link;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::__link(Node **link, Node *node, Node **path[], int depth)
+{
+    *link = node;
+    if(depth > 0)
+        node->_parent = *path[depth - 1];
+    _size++;
+    __retrace(path, depth);
+}
+
+// path[0..depth) are the links from the root down to the parent of the
+// changed position. Walking back up stops as soon as a subtree comes out of
+// rebalancing with the height it had before, since nothing above it moves.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::__retrace(AVL_Tree::Node **path[], int depth)
+{
+    while(depth-- > 0)
+    {
+        Node * node = *path[depth];
+        unsigned height = node->_height;
+        node->__update_height();
+        node = node->__balance();
+        *path[depth] = node;
+        if(node->_height == height)
+            break;
+    }
+    while(depth-- > 0)
+    {
+        if(Augment::ENABLED)
+            (*path[depth])->__update_height();
         else
-            _right = new Node(value);
+            (*path[depth])->__update_count();
     }
+}
 
-    __update_height();
-    Node * root = __balance();
+// __retrace() for a change below node, found by walking parent pointers
+// instead of following a recorded path.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::__retrace_from(Node *node)
+{
+    while(node != NULL)
+    {
+        Node * parent = node->_parent;
+        Node ** link = parent == NULL ? &_root : (parent->_left == node ? &parent->_left : &parent->_right);
+        unsigned height = node->_height;
+        node->__update_height();
+        *link = node->__balance();
+        node = parent;
+        if((*link)->_height == height)
+            break;
+    }
+    for(; node != NULL; node = node->_parent)
+    {
+        if(Augment::ENABLED)
+            node->__update_height();
+        else
+            node->__update_count();
+    }
+}
+
+// Builds a subtree out of the next count elements, in order. Both halves
+// differ in size by at most one, so heights come out exact and no node
+// needs rebalancing.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+template <typename Forward_Iterator>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::__build(Forward_Iterator &first, std::size_t count)
+{
+    if(count == 0)
+        return NULL;
+    Node * left = __build(first, count / 2);
+    Node * root = __create(*first);
+    ++first;
+    root->_left = left;
+    root->_right = __build(first, count - count / 2 - 1);
+    if(root->_left != NULL)
+        root->_left->_parent = root;
+    if(root->_right != NULL)
+        root->_right->_parent = root;
+    root->__update_height();
     return root;
 }
 
-template <typename T>
-typename AVL_Tree<T>::Node *AVL_Tree<T>::Node::__max()
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+unsigned AVL_Tree<T, Allocator, Augment, Stats, Compare>::__count_less(const T & value) const
+{
+    unsigned count = 0;
+    Node * node = _root;
+    while(node != NULL)
+    {
+        if(Compare::compare(node->_value, value) < 0)
+        {
+            count += 1 + (node->_left == NULL ? 0 : node->_left->_count);
+            node = node->_right;
+        }
+        else
+            node = node->_left;
+    }
+    return count;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+unsigned AVL_Tree<T, Allocator, Augment, Stats, Compare>::__count_not_greater(const T & value) const
+{
+    unsigned count = 0;
+    Node * node = _root;
+    while(node != NULL)
+    {
+        if(Compare::compare(value, node->_value) < 0)
+            node = node->_left;
+        else
+        {
+            count += 1 + (node->_left == NULL ? 0 : node->_left->_count);
+            node = node->_right;
+        }
+    }
+    return count;
+}
+
+// Positions of the batch elements greater than the last one kept.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+vector<std::size_t> AVL_Tree<T, Allocator, Augment, Stats, Compare>::__strictly_increasing(const vector<const T *> &values)
+{
+    vector<std::size_t> batch;
+    batch.reserve(values.size());
+    for(std::size_t i = 0; i < values.size(); i++)
+        if(batch.empty() || Compare::compare(*values[batch.back()], *values[i]) < 0)
+            batch.push_back(i);
+    return batch;
+}
+
+// Splits a strictly increasing batch into the elements less than value,
+// those equal to it, and those greater, by binary search.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::__partition(const T &value, const std::size_t *first, const std::size_t *last, const T * const *values,
+                                                  const std::size_t *&less_end, const std::size_t *&greater_begin)
+{
+    less_end = std::partition_point(first, last, [&](std::size_t i) { return Compare::compare(*values[i], value) < 0; });
+    greater_begin = std::partition_point(less_end, last, [&](std::size_t i) { return Compare::compare(*values[i], value) <= 0; });
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::__insert_batch(AVL_Tree::Node *root, const std::size_t *first, const std::size_t *last, const T * const *values, char *inserted)
+{
+    if(first == last)
+        return root;
+    if(root == NULL)
+    {
+        const std::size_t * middle = first + (last - first) / 2;
+        Node * node = __create(*values[*middle]);
+        inserted[*middle] = 1;
+        Node * left = __insert_batch(NULL, first, middle, values, inserted);
+        Node * right = __insert_batch(NULL, middle + 1, last, values, inserted);
+        return __join(left, node, right);
+    }
+    const std::size_t * less_end;
+    const std::size_t * greater_begin;
+    __partition(root->_value, first, last, values, less_end, greater_begin);
+    Node * left = __insert_batch(root->_left, first, less_end, values, inserted);
+    Node * right = __insert_batch(root->_right, greater_begin, last, values, inserted);
+    return __join(left, root, right);
+}
+
+// The first query equal to root removes it. The other queries equal to it
+// come after that one, so whatever else they can still match lies to the
+// right, and they go down there with the greater ones.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::__remove_batch(AVL_Tree::Node *root, const std::size_t *first, const std::size_t *last, const T * const *values, char *removed)
+{
+    if(first == last || root == NULL)
+        return root;
+    const std::size_t * less_end;
+    const std::size_t * greater_begin;
+    __partition(root->_value, first, last, values, less_end, greater_begin);
+    Node * left = __remove_batch(root->_left, first, less_end, values, removed);
+    if(less_end == greater_begin)
+        return __join(left, root, __remove_batch(root->_right, greater_begin, last, values, removed));
+    removed[*less_end] = 1;
+    Node * right = __remove_batch(root->_right, less_end + 1, last, values, removed);
+    __destroy(root);
+    return __join(left, right);
+}
+
+// Links two subtrees under middle, given that everything in left is less
+// than middle and everything in right greater. The shorter subtree is hung
+// on the spine of the taller one where the heights meet, and only that
+// spine is rebalanced: O(|height(left) - height(right)| + 1).
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::__join(AVL_Tree::Node *left, AVL_Tree::Node *middle, AVL_Tree::Node *right)
+{
+    if(left != NULL)
+        left->_parent = NULL;
+    if(right != NULL)
+        right->_parent = NULL;
+    middle->_parent = NULL;
+    if(__height(left) > __height(right) + 1)
+        return __join_right(left, middle, right);
+    if(__height(right) > __height(left) + 1)
+        return __join_left(left, middle, right);
+    middle->_left = left;
+    middle->_right = right;
+    if(left != NULL)
+        left->_parent = middle;
+    if(right != NULL)
+        right->_parent = middle;
+    middle->__update_height();
+    return middle;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::__join_right(AVL_Tree::Node *left, AVL_Tree::Node *middle, AVL_Tree::Node *right)
+{
+    Node * node = left;
+    while(__height(node->_right) > __height(right) + 1)
+        node = node->_right;
+    middle->_left = node->_right;
+    middle->_right = right;
+    if(middle->_left != NULL)
+        middle->_left->_parent = middle;
+    if(right != NULL)
+        right->_parent = middle;
+    middle->__update_height();
+    node->_right = middle;
+    middle->_parent = node;
+    while(true)
+    {
+        Node * parent = node->_parent;
+        node->__update_height();
+        node = node->__balance();
+        if(parent == NULL)
+            return node;
+        parent->_right = node;
+        node = parent;
+    }
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::__join_left(AVL_Tree::Node *left, AVL_Tree::Node *middle, AVL_Tree::Node *right)
+{
+    Node * node = right;
+    while(__height(node->_left) > __height(left) + 1)
+        node = node->_left;
+    middle->_right = node->_left;
+    middle->_left = left;
+    if(middle->_right != NULL)
+        middle->_right->_parent = middle;
+    if(left != NULL)
+        left->_parent = middle;
+    middle->__update_height();
+    node->_left = middle;
+    middle->_parent = node;
+    while(true)
+    {
+        Node * parent = node->_parent;
+        node->__update_height();
+        node = node->__balance();
+        if(parent == NULL)
+            return node;
+        parent->_left = node;
+        node = parent;
+    }
+}
+
+// Joins two subtrees without a middle element: the smallest element of
+// right is taken out and used as one.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::__join(AVL_Tree::Node *left, AVL_Tree::Node *right)
+{
+    if(right == NULL)
+    {
+        if(left != NULL)
+            left->_parent = NULL;
+        return left;
+    }
+    Node * min;
+    right = __remove_min(right, min);
+    return __join(left, min, right);
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::__remove_min(AVL_Tree::Node *root, AVL_Tree::Node *&min)
+{
+    if(root->_left == NULL)
+    {
+        min = root;
+        if(root->_right != NULL)
+            root->_right->_parent = NULL;
+        return root->_right;
+    }
+    Node * left = __remove_min(root->_left, min);
+    return __join(left, root, root->_right);
+}
+
+// Cuts root's subtree into the elements less than key and the others.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::__split(AVL_Tree::Node *root, const T &key, AVL_Tree::Node *&left, AVL_Tree::Node *&right)
+{
+    if(root == NULL)
+    {
+        left = right = NULL;
+        return;
+    }
+    Node * lower;
+    Node * upper;
+    if(Compare::compare(root->_value, key) < 0)
+    {
+        __split(root->_right, key, lower, upper);
+        left = __join(root->_left, root, lower);
+        right = upper;
+    }
+    else
+    {
+        __split(root->_left, key, lower, upper);
+        left = lower;
+        right = __join(upper, root, root->_right);
+    }
+}
+
+// Like __split, with the elements equal to key taken out and appended to
+// middle in order. Only nodes overlapping key make the search go both ways.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::__split3(AVL_Tree::Node *root, const T &key, AVL_Tree::Node *&left, vector<AVL_Tree::Node *> &middle, AVL_Tree::Node *&right)
+{
+    if(root == NULL)
+    {
+        left = right = NULL;
+        return;
+    }
+    Node * lower;
+    Node * upper;
+    int order = Compare::compare(root->_value, key);
+    if(order < 0)
+    {
+        __split3(root->_right, key, lower, middle, upper);
+        left = __join(root->_left, root, lower);
+        right = upper;
+    }
+    else if(order > 0)
+    {
+        __split3(root->_left, key, lower, middle, upper);
+        left = lower;
+        right = __join(upper, root, root->_right);
+    }
+    else
+    {
+        Node * root_right = root->_right;
+        __split3(root->_left, key, left, middle, upper);
+        middle.push_back(root);
+        __split3(root_right, key, lower, middle, right);
+    }
+}
+
+// Merges other's node pool into this tree's, so its nodes can be linked
+// here.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::__adopt_pool(AVL_Tree &other)
+{
+    Pool & pool = __pool();
+    Pool & other_pool = other.__pool();
+    if(&pool != &other_pool)
+        pool.absorb(other_pool, _pool);
+    other._pool = _pool;
+}
+
+// Pivots on mine, whose elements are kept: the elements of theirs
+// overlapping the pivot are dropped, the others go to the side they fall
+// on. Nothing in theirs below the pivot can overlap mine above it.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::__union(AVL_Tree::Node *mine, AVL_Tree::Node *theirs, vector<AVL_Tree::Node *> &dropped, int spawn)
+{
+    if(theirs == NULL)
+        return mine;
+    if(mine == NULL)
+        return theirs;
+    Node * left;
+    Node * right;
+    __split3(theirs, mine->_value, left, dropped, right);
+    Node * mine_left = mine->_left;
+    Node * mine_right = mine->_right;
+    if(spawn > 0 && __count(mine) >= PARALLEL_GRAIN)
+    {
+        vector<Node *> dropped_left;
+        std::future<Node *> lower = std::async(std::launch::async, [&]() {
+            return __union(mine_left, left, dropped_left, spawn - 1);
+        });
+        Node * upper = __union(mine_right, right, dropped, spawn - 1);
+        Node * joined_left = lower.get();
+        dropped.insert(dropped.end(), dropped_left.begin(), dropped_left.end());
+        return __join(joined_left, mine, upper);
+    }
+    Node * lower = __union(mine_left, left, dropped, 0);
+    return __join(lower, mine, __union(mine_right, right, dropped, 0));
+}
+
+// Pivots on theirs, which is only read: the elements of mine overlapping
+// the pivot are kept, and are parked at the end of scratch until both
+// sides are done.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::__intersect(AVL_Tree::Node *mine, const AVL_Tree::Node *theirs, vector<AVL_Tree::Node *> &scratch, int spawn)
+{
+    if(mine == NULL)
+        return NULL;
+    if(theirs == NULL)
+    {
+        __collect(mine, scratch);
+        return NULL;
+    }
+    Node * left;
+    Node * right;
+    std::size_t kept = scratch.size();
+    __split3(mine, theirs->_value, left, scratch, right);
+    vector<Node *> middle(scratch.begin() + kept, scratch.end());
+    scratch.resize(kept);
+    Node * lower;
+    Node * upper;
+    if(spawn > 0 && __count(left) + __count(right) >= PARALLEL_GRAIN)
+    {
+        vector<Node *> scratch_left;
+        std::future<Node *> task = std::async(std::launch::async, [&]() {
+            return __intersect(left, theirs->_left, scratch_left, spawn - 1);
+        });
+        upper = __intersect(right, theirs->_right, scratch, spawn - 1);
+        lower = task.get();
+        scratch.insert(scratch.end(), scratch_left.begin(), scratch_left.end());
+    }
+    else
+    {
+        lower = __intersect(left, theirs->_left, scratch, 0);
+        upper = __intersect(right, theirs->_right, scratch, 0);
+    }
+    if(middle.empty())
+        return __join(lower, upper);
+    for(std::size_t i = 0; i + 1 < middle.size(); i++)
+        lower = __join(lower, middle[i], NULL);
+    return __join(lower, middle.back(), upper);
+}
+
+// Pivots on theirs, which is only read: the elements of mine overlapping
+// the pivot are dropped.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::__subtract(AVL_Tree::Node *mine, const AVL_Tree::Node *theirs, vector<AVL_Tree::Node *> &dropped, int spawn)
+{
+    if(mine == NULL || theirs == NULL)
+        return mine;
+    Node * left;
+    Node * right;
+    __split3(mine, theirs->_value, left, dropped, right);
+    Node * lower;
+    Node * upper;
+    if(spawn > 0 && __count(left) + __count(right) >= PARALLEL_GRAIN)
+    {
+        vector<Node *> dropped_left;
+        std::future<Node *> task = std::async(std::launch::async, [&]() {
+            return __subtract(left, theirs->_left, dropped_left, spawn - 1);
+        });
+        upper = __subtract(right, theirs->_right, dropped, spawn - 1);
+        lower = task.get();
+        dropped.insert(dropped.end(), dropped_left.begin(), dropped_left.end());
+    }
+    else
+    {
+        lower = __subtract(left, theirs->_left, dropped, 0);
+        upper = __subtract(right, theirs->_right, dropped, 0);
+    }
+    return __join(lower, upper);
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::__collect(AVL_Tree::Node *root, vector<AVL_Tree::Node *> &nodes)
+{
+    if(root == NULL)
+        return;
+    __collect(root->_left, nodes);
+    nodes.push_back(root);
+    __collect(root->_right, nodes);
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::__finish_set_operation(AVL_Tree::Node *root, const vector<AVL_Tree::Node *> &dropped)
+{
+    for(std::size_t i = 0; i < dropped.size(); i++)
+        __destroy(dropped[i]);
+    _root = root;
+    if(_root != NULL)
+        _root->_parent = NULL;
+    _size = __count(_root);
+}
+
+// How many levels of the set operations may fork: enough for every
+// hardware thread to get a couple of tasks.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+int AVL_Tree<T, Allocator, Augment, Stats, Compare>::__spawn_depth()
+{
+    int depth = 1;
+    for(unsigned threads = std::thread::hardware_concurrency(); threads > 1; threads /= 2)
+        depth++;
+    return depth;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+unsigned AVL_Tree<T, Allocator, Augment, Stats, Compare>::__height(const AVL_Tree::Node *node)
+{
+    return node == NULL ? 0 : node->_height;
+}
+
+// FNV-1a over size bytes, continuing from hash. Start from CHECKSUM_SEED.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+uint64_t AVL_Tree<T, Allocator, Augment, Stats, Compare>::__checksum(uint64_t hash, const char *bytes, std::size_t size)
+{
+    for(std::size_t i = 0; i < size; i++)
+        hash = (hash ^ (unsigned char)bytes[i]) * 1099511628211ULL;
+    return hash;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+unsigned AVL_Tree<T, Allocator, Augment, Stats, Compare>::__count(const AVL_Tree::Node *node)
+{
+    return node == NULL ? 0 : node->_count;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+int AVL_Tree<T, Allocator, Augment, Stats, Compare>::__compare(const T &a, const T &b)
+{
+    Stats::compared();
+    return Compare::compare(a, b);
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::__destroy(AVL_Tree::Node *node)
+{
+    Stats::freed(1);
+    node->~Node();
+    __pool().deallocate(node);
+    _epoch++;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::__destroy_subtree(AVL_Tree::Node *root)
+{
+    if(root == NULL)
+        return;
+    __destroy_subtree(root->_left);
+    __destroy_subtree(root->_right);
+    root->~Node();
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::__deallocate_subtree(AVL_Tree::Node *root)
+{
+    if(root == NULL)
+        return;
+    __deallocate_subtree(root->_left);
+    __deallocate_subtree(root->_right);
+    root->~Node();
+    _pool->deallocate(root);
+}
+
+
+// ITERATOR
+// Iterator at a node a derived tree found by its own search, or end() for
+// NULL.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator AVL_Tree<T, Allocator, Augment, Stats, Compare>::__iterator(Node *node) const
+{
+    return const_iterator(node, this);
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator::const_iterator(): _node(NULL), _tree(NULL) {}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator::const_iterator(Node *node, const AVL_Tree *tree): _node(node), _tree(tree) {}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator::reference AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator::operator*() const
+{
+    return _node->_value;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator::pointer AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator::operator->() const
+{
+    return &_node->_value;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator &AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator::operator++()
+{
+    _node = _node->__next();
+    return *this;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator::operator++(int)
+{
+    const_iterator previous = *this;
+    ++*this;
+    return previous;
+}
+
+// Stepping back from end() lands on the largest element.
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator &AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator::operator--()
+{
+    if(_node == NULL)
+        _node = _tree->_root->__max();
+    else
+        _node = _node->__prev();
+    return *this;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator::operator--(int)
+{
+    const_iterator previous = *this;
+    --*this;
+    return previous;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+bool AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator::operator==(const const_iterator &o) const
+{
+    return _node == o._node;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+bool AVL_Tree<T, Allocator, Augment, Stats, Compare>::const_iterator::operator!=(const const_iterator &o) const
+{
+    return _node != o._node;
+}
+
+
+// NODE
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node::__update_height()
+{
+
+    if(_left == NULL && _right == NULL)
+        _height = 1;
+    else if(_left == NULL)
+        _height = _right->_height + 1;
+    else if(_right == NULL)
+        _height = _left->_height + 1;
+    else
+        _height = max(_right->_height, _left->_height) + 1;
+
+    __update_count();
+    Augment::update(_summary, _value, _left == NULL ? NULL : &_left->_summary, _right == NULL ? NULL : &_right->_summary);
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+void AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node::__update_count()
+{
+    _count = 1;
+    if(_left != NULL)
+        _count += _left->_count;
+    if(_right != NULL)
+        _count += _right->_count;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node::__min()
+{
+    if(_left == NULL)
+        return this;
+    return _left->__min();
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node::__next()
+{
+    if(_right != NULL)
+        return _right->__min();
+    Node * node = this;
+    while(node->_parent != NULL && node->_parent->_right == node)
+        node = node->_parent;
+    return node->_parent;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node::__prev()
+{
+    if(_left != NULL)
+        return _left->__max();
+    Node * node = this;
+    while(node->_parent != NULL && node->_parent->_left == node)
+        node = node->_parent;
+    return node->_parent;
+}
+
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node::__max()
 {
     if(_right == NULL)
         return this;
     return _right->__max();
 }
 
-template <typename T>
-typename AVL_Tree<T>::Node *AVL_Tree<T>::Node::__balance()
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node::__balance()
 {
     Node * root = this;
     switch(__balance_factor())
     {
     case UNBALANCED_TO_RIGHT:
         if(_right->__balance_factor() == BALANCED_TO_LEFT)
+        {
+            Stats::rotated(RL_ROTATION);
             root = __RL_rotate();
+        }
         else
+        {
+            Stats::rotated(LL_ROTATION);
             root = __LL_rotate();
+        }
         break;
     case UNBALANCED_TO_LEFT:
         if(_left->__balance_factor() == BALANCED_TO_RIGHT)
+        {
+            Stats::rotated(LR_ROTATION);
             root = __LR_rotate();
+        }
         else
+        {
+            Stats::rotated(RR_ROTATION);
             root = __RR_rotate();
+        }
         break;
     }
 
     return root;
 }
 
-template <typename T>
-typename AVL_Tree<T>::Node *AVL_Tree<T>::Node::__RR_rotate()
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node::__RR_rotate()
 {
     Node * a = _left;
     _left = a->_right;
+    if(_left != NULL)
+        _left->_parent = this;
     a->_right = this;
+    a->_parent = _parent;
+    _parent = a;
     __update_height();
     a->__update_height();
     return a;
 }
 
-template <typename T>
-typename AVL_Tree<T>::Node *AVL_Tree<T>::Node::__LR_rotate()
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node::__LR_rotate()
 {
     _left = _left->__LL_rotate();
     return __RR_rotate();
 }
 
-template <typename T>
-typename AVL_Tree<T>::Node *AVL_Tree<T>::Node::__RL_rotate()
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node::__RL_rotate()
 {
     _right = _right->__RR_rotate();
     return __LL_rotate();
 }
 
-template <typename T>
-typename AVL_Tree<T>::Node *AVL_Tree<T>::Node::__LL_rotate()
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+typename AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node *AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node::__LL_rotate()
 {
     Node * a = _right;
     _right = a->_left;
+    if(_right != NULL)
+        _right->_parent = this;
     a->_left = this;
+    a->_parent = _parent;
+    _parent = a;
     __update_height();
     a->__update_height();
     return a;
 }
 
-template <typename T>
-AVL_Tree<T>::Node::Node(const T & value): _left(NULL), _right(NULL), _value(value), _height(1)
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+template <typename... Args>
+AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node::Node(Args &&... args):
+    _left(NULL), _right(NULL), _parent(NULL), _value(std::forward<Args>(args)...), _height(1), _count(1)
 {
-
-}
-
-template <typename T>
-AVL_Tree<T>::Node::~Node()
-{
-    if(_left != NULL)
-        delete _left;
-    if(_right != NULL)
-        delete _right;
+    Augment::update(_summary, _value, NULL, NULL);
 }
 
 
-template <typename T>
-int AVL_Tree<T>::Node::__balance_factor() const
+template <typename T, typename Allocator, typename Augment, typename Stats, typename Compare>
+int AVL_Tree<T, Allocator, Augment, Stats, Compare>::Node::__balance_factor() const
 {
     int right_height = 1;
     int left_height = 1;
@@ -0,0 +1,405 @@
+// Throughput of AVL_Tree against std::set on the same keys. Prints one CSV
+// line per run:
+//
+//   structure,workload,size,operations,seconds,ns_per_op,ns_per_level,ops_per_sec,peak_rss_kb
+//
+// Usage: avl_benchmark [--sizes 1000,1000000] [--workloads random,zipf]
+//                      [--structures avl_tree,avl_tree_hinted,std_set]
+//                      [--seed N]
+//
+// avl_tree_less_greater descends with operator< then operator>, two
+// comparisons per level, where avl_tree makes one three-way comparison.
+// avl_tree_hinted inserts with the position of the previous insert as the
+// hint, which pays off on the sorted and near_sorted workloads; the latter
+// inserts ascending keys locally shuffled, each swapped with one of the
+// next NEAR_SORTED_SPAN.
+// ns_per_level divides ns_per_op by log2(size + 1), the depth of a
+// balanced search, to compare the cost of one level across sizes.
+//
+// Peak RSS is the high-water mark of the whole process, so for a clean
+// figure run a single structure and size per invocation.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+using std::shuffle;
+
+#include <chrono>
+
+#include <random>
+using std::mt19937_64;
+using std::uniform_int_distribution;
+using std::uniform_real_distribution;
+
+#include <set>
+using std::set;
+
+#include <string>
+using std::string;
+
+#include <utility>
+using std::swap;
+
+#include <vector>
+using std::vector;
+
+#include <sys/resource.h>
+
+#include "avl_tree.h"
+#include "interval.h"
+
+static const int STRIDE = 10;
+static const unsigned WIDTH = 5;
+static const unsigned NEAR_SORTED_SPAN = 16;
+
+// Same order AVL_Tree uses: a range is less than another when it ends
+// before the other begins.
+struct Interval_Less {
+    bool operator()(const NonOverlappingInterval & a, const NonOverlappingInterval & b) const {
+        return a < b;
+    }
+};
+
+struct Less_Greater_Compare {
+    static int compare(const NonOverlappingInterval & a, const NonOverlappingInterval & b) {
+        if(a < b)
+            return -1;
+        if(a > b)
+            return 1;
+        return 0;
+    }
+};
+
+template <typename Compare>
+class Tree_Adapter
+{
+    AVL_Tree<NonOverlappingInterval, allocator<NonOverlappingInterval>, No_Augment<NonOverlappingInterval>, No_Stats, Compare> _tree;
+public:
+    static const char * name();
+    bool insert(const NonOverlappingInterval & value) { return _tree.insert(value); }
+    bool find(const NonOverlappingInterval & value) { return _tree.find(value) != _tree.end(); }
+    bool remove(const NonOverlappingInterval & value) { return _tree.remove(value); }
+};
+
+template <>
+const char *Tree_Adapter<Three_Way_Compare<NonOverlappingInterval> >::name() { return "avl_tree"; }
+
+template <>
+const char *Tree_Adapter<Less_Greater_Compare>::name() { return "avl_tree_less_greater"; }
+
+// Keeps the last inserted position as a finger. A remove may free the
+// finger's node, so it falls back to end().
+class Hinted_Tree_Adapter
+{
+    AVL_Tree<NonOverlappingInterval> _tree;
+    AVL_Tree<NonOverlappingInterval>::const_iterator _finger;
+public:
+    Hinted_Tree_Adapter(): _finger(_tree.end()) {}
+    static const char * name() { return "avl_tree_hinted"; }
+    bool insert(const NonOverlappingInterval & value) {
+        unsigned size = _tree.size();
+        _finger = _tree.insert(_finger, value);
+        return _tree.size() != size;
+    }
+    bool find(const NonOverlappingInterval & value) { return _tree.find(value) != _tree.end(); }
+    bool remove(const NonOverlappingInterval & value) {
+        _finger = _tree.end();
+        return _tree.remove(value);
+    }
+};
+
+class Set_Adapter
+{
+    set<NonOverlappingInterval, Interval_Less> _set;
+public:
+    static const char * name() { return "std_set"; }
+    bool insert(const NonOverlappingInterval & value) { return _set.insert(value).second; }
+    bool find(const NonOverlappingInterval & value) { return _set.find(value) != _set.end(); }
+    bool remove(const NonOverlappingInterval & value) { return _set.erase(value) != 0; }
+};
+
+struct Result {
+    std::size_t operations;
+    double seconds;
+    unsigned long checksum;
+};
+
+static NonOverlappingInterval stored(unsigned key)
+{
+    return NonOverlappingInterval(int(key) * STRIDE, WIDTH);
+}
+
+// Overlaps the range stored for key without being equal to it.
+static NonOverlappingInterval probe(unsigned key)
+{
+    return NonOverlappingInterval(int(key) * STRIDE + 1, 2);
+}
+
+static vector<unsigned> shuffled(unsigned n, mt19937_64 & random)
+{
+    vector<unsigned> keys(n);
+    for(unsigned i = 0; i < n; i++)
+        keys[i] = i;
+    shuffle(keys.begin(), keys.end(), random);
+    return keys;
+}
+
+static vector<unsigned> near_sorted(unsigned n, mt19937_64 & random)
+{
+    vector<unsigned> keys(n);
+    for(unsigned i = 0; i < n; i++)
+        keys[i] = i;
+    uniform_int_distribution<unsigned> offset(0, NEAR_SORTED_SPAN - 1);
+    for(unsigned i = 0; i < n; i++)
+    {
+        unsigned j = i + offset(random);
+        if(j < n)
+            swap(keys[i], keys[j]);
+    }
+    return keys;
+}
+
+// Zipf with exponent 1 over n ranks by inverting the continuous CDF, which
+// needs no table. Ranks are scattered over the key space so that hot keys
+// are not all on the leftmost path.
+static vector<unsigned> zipfian(unsigned n, std::size_t count, mt19937_64 & random)
+{
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    vector<unsigned> keys(count);
+    for(std::size_t i = 0; i < count; i++)
+    {
+        unsigned long long rank = (unsigned long long)std::exp(uniform(random) * std::log(double(n) + 1.0)) - 1;
+        if(rank >= n)
+            rank = n - 1;
+        keys[i] = unsigned((rank * 2654435761ULL) % n);
+    }
+    return keys;
+}
+
+class Clock
+{
+    std::chrono::steady_clock::time_point _start;
+public:
+    Clock(): _start(std::chrono::steady_clock::now()) {}
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+    }
+};
+
+template <typename Structure>
+static Result run_insert(const vector<unsigned> & keys)
+{
+    Structure structure;
+    Result result = { keys.size(), 0, 0 };
+    Clock clock;
+    for(std::size_t i = 0; i < keys.size(); i++)
+        result.checksum += structure.insert(stored(keys[i]));
+    result.seconds = clock.seconds();
+    return result;
+}
+
+template <typename Structure>
+static Result run_find(unsigned n, const vector<unsigned> & queries, mt19937_64 & random)
+{
+    Structure structure;
+    const vector<unsigned> keys = shuffled(n, random);
+    for(std::size_t i = 0; i < keys.size(); i++)
+        structure.insert(stored(keys[i]));
+    Result result = { queries.size(), 0, 0 };
+    Clock clock;
+    for(std::size_t i = 0; i < queries.size(); i++)
+        result.checksum += structure.find(probe(queries[i]));
+    result.seconds = clock.seconds();
+    return result;
+}
+
+// Half of the key space is stored up front; then n operations, half finds
+// and a quarter each inserts and removes, on uniformly random keys.
+template <typename Structure>
+static Result run_mixed(unsigned n, mt19937_64 & random)
+{
+    Structure structure;
+    const vector<unsigned> keys = shuffled(n, random);
+    for(std::size_t i = 0; i < keys.size(); i += 2)
+        structure.insert(stored(keys[i]));
+    uniform_int_distribution<unsigned> key(0, n - 1);
+    uniform_int_distribution<unsigned> kind(0, 3);
+    vector<std::pair<unsigned, unsigned> > operations(n);
+    for(unsigned i = 0; i < n; i++)
+        operations[i] = std::make_pair(kind(random), key(random));
+    Result result = { operations.size(), 0, 0 };
+    Clock clock;
+    for(std::size_t i = 0; i < operations.size(); i++)
+    {
+        unsigned k = operations[i].second;
+        switch(operations[i].first)
+        {
+        case 0:
+            result.checksum += structure.insert(stored(k));
+            break;
+        case 1:
+            result.checksum += structure.remove(probe(k));
+            break;
+        default:
+            result.checksum += structure.find(probe(k));
+        }
+    }
+    result.seconds = clock.seconds();
+    return result;
+}
+
+template <typename Structure>
+static Result run(const string & workload, unsigned n, mt19937_64 & random)
+{
+    if(workload == "random")
+        return run_insert<Structure>(shuffled(n, random));
+    if(workload == "sorted" || workload == "reverse")
+    {
+        vector<unsigned> keys(n);
+        for(unsigned i = 0; i < n; i++)
+            keys[i] = workload == "sorted" ? i : n - 1 - i;
+        return run_insert<Structure>(keys);
+    }
+    if(workload == "near_sorted")
+        return run_insert<Structure>(near_sorted(n, random));
+    if(workload == "zipf")
+        return run_find<Structure>(n, zipfian(n, n, random), random);
+    return run_mixed<Structure>(n, random);
+}
+
+static long peak_rss_kb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static vector<string> split(const char * list)
+{
+    vector<string> items;
+    string current;
+    for(const char * c = list; ; c++)
+    {
+        if(*c == ',' || *c == '\0')
+        {
+            if(!current.empty())
+                items.push_back(current);
+            current.clear();
+            if(*c == '\0')
+                return items;
+        }
+        else
+            current += *c;
+    }
+}
+
+static bool contains(const vector<string> & items, const char * item)
+{
+    return std::find(items.begin(), items.end(), string(item)) != items.end();
+}
+
+template <typename Structure>
+static void report(const string & workload, unsigned n, unsigned long long seed)
+{
+    mt19937_64 random(seed);
+    Result result = run<Structure>(workload, n, random);
+    double ns_per_op = result.seconds * 1e9 / result.operations;
+    double ns_per_level = ns_per_op / std::log2(double(n) + 1);
+    std::printf("%s,%s,%u,%zu,%.6f,%.2f,%.3f,%.0f,%ld\n", Structure::name(), workload.c_str(), n,
+                result.operations, result.seconds, ns_per_op, ns_per_level, 1e9 / ns_per_op, peak_rss_kb());
+    std::fflush(stdout);
+    if(result.checksum == 0 && n > 0)
+        std::fprintf(stderr, "%s %s: no operation succeeded\n", Structure::name(), workload.c_str());
+}
+
+static void usage(FILE * out)
+{
+    std::fprintf(out, "usage: avl_benchmark [--sizes 1000,1000000] [--workloads random,zipf]\n"
+                      "                     [--structures avl_tree,avl_tree_hinted,std_set]\n"
+                      "                     [--seed N]\n");
+}
+
+// Every argument is checked before anything runs, since the default run
+// goes up to 10M elements.
+int main(int argc, char ** argv)
+{
+    const vector<string> known_workloads = split("random,sorted,reverse,near_sorted,zipf,mixed");
+    const vector<string> known_structures = split("avl_tree,avl_tree_less_greater,avl_tree_hinted,std_set");
+    vector<string> sizes = split("1000,10000,100000,1000000,10000000");
+    vector<string> workloads = known_workloads;
+    vector<string> structures = known_structures;
+    unsigned long long seed = 0;
+    if(argc == 2 && (std::strcmp(argv[1], "--help") == 0 || std::strcmp(argv[1], "-h") == 0))
+    {
+        usage(stdout);
+        return 0;
+    }
+    if(argc % 2 == 0)
+    {
+        std::fprintf(stderr, "option %s needs a value\n", argv[argc - 1]);
+        usage(stderr);
+        return 1;
+    }
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(std::strcmp(argv[i], "--sizes") == 0)
+            sizes = split(argv[i + 1]);
+        else if(std::strcmp(argv[i], "--workloads") == 0)
+            workloads = split(argv[i + 1]);
+        else if(std::strcmp(argv[i], "--structures") == 0)
+            structures = split(argv[i + 1]);
+        else if(std::strcmp(argv[i], "--seed") == 0)
+            seed = std::strtoull(argv[i + 1], NULL, 10);
+        else
+        {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            usage(stderr);
+            return 1;
+        }
+    }
+
+    for(std::size_t w = 0; w < workloads.size(); w++)
+        if(!contains(known_workloads, workloads[w].c_str()))
+        {
+            std::fprintf(stderr, "unknown workload %s\n", workloads[w].c_str());
+            return 1;
+        }
+    for(std::size_t t = 0; t < structures.size(); t++)
+        if(!contains(known_structures, structures[t].c_str()))
+        {
+            std::fprintf(stderr, "unknown structure %s\n", structures[t].c_str());
+            return 1;
+        }
+    vector<unsigned> counts;
+    for(std::size_t s = 0; s < sizes.size(); s++)
+    {
+        unsigned long n = std::strtoul(sizes[s].c_str(), NULL, 10);
+        if(n == 0 || n > (unsigned long)(numeric_limits<int>::max() / STRIDE))
+        {
+            std::fprintf(stderr, "size %s out of range\n", sizes[s].c_str());
+            return 1;
+        }
+        counts.push_back(unsigned(n));
+    }
+
+    std::printf("structure,workload,size,operations,seconds,ns_per_op,ns_per_level,ops_per_sec,peak_rss_kb\n");
+    for(std::size_t s = 0; s < counts.size(); s++)
+    {
+        unsigned n = counts[s];
+        for(std::size_t w = 0; w < workloads.size(); w++)
+        {
+            if(contains(structures, Tree_Adapter<Three_Way_Compare<NonOverlappingInterval> >::name()))
+                report<Tree_Adapter<Three_Way_Compare<NonOverlappingInterval> > >(workloads[w], n, seed);
+            if(contains(structures, Tree_Adapter<Less_Greater_Compare>::name()))
+                report<Tree_Adapter<Less_Greater_Compare> >(workloads[w], n, seed);
+            if(contains(structures, Hinted_Tree_Adapter::name()))
+                report<Hinted_Tree_Adapter>(workloads[w], n, seed);
+            if(contains(structures, Set_Adapter::name()))
+                report<Set_Adapter>(workloads[w], n, seed);
+        }
+    }
+    return 0;
+}
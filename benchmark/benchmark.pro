@@ -0,0 +1,22 @@
+#-------------------------------------------------
+#
+# Throughput benchmark, built apart from the tests
+#
+#-------------------------------------------------
+
+QT       -= core gui
+
+TARGET = avl_benchmark
+CONFIG   += console release
+CONFIG   -= app_bundle qt
+CONFIG   += c++11
+
+QMAKE_CXXFLAGS += -Wall -Werror
+
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    ../interval.cpp \
+    benchmark.cpp
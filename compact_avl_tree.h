@@ -0,0 +1,505 @@
+#ifndef COMPACT_AVL_TREE_H
+#define COMPACT_AVL_TREE_H
+
+#include <cstddef>
+#include <cstdint>
+using std::uint32_t;
+
+#include <stdexcept>
+
+#include <utility>
+
+#include <vector>
+using std::vector;
+
+// Storage policy for Compact_AVL_Tree: a vector on the heap, with nothing
+// to restore or flush. See mapped_storage.h for nodes kept in a file.
+template <typename Node>
+class Vector_Storage : public vector<Node>
+{
+public:
+    bool is_open() const { return true; }
+    bool modify() { return true; }
+    bool restore(uint32_t &, uint32_t &, unsigned &) const { return false; }
+    bool flush(uint32_t, uint32_t, unsigned) { return true; }
+};
+
+// Same interface as AVL_Tree, with all nodes stored in one array and
+// linked through 31-bit indices. The spare top bit of each link marks the
+// taller side of the node, so a node is just the value plus 8 bytes and
+// there is no per-node heap allocation. Holds at most 2^31 - 1 elements;
+// an insert past that throws length_error and leaves the tree as it was.
+//
+// Storage<Node> holds the array. Besides the vector operations the tree
+// uses, it is asked to modify() before every change, which fails for
+// read-only storage, to restore() the tree's state when it is created,
+// and to flush() that state.
+template <typename T, template <typename> class Storage = Vector_Storage>
+class Compact_AVL_Tree
+{
+    static const uint32_t NIL = 0x7FFFFFFF;
+    static const uint32_t INDEX_MASK = 0x7FFFFFFF;
+    static const uint32_t HEAVY_BIT = 0x80000000;
+    static const int MAX_HEIGHT = 64;
+
+    class Node {
+    public:
+        T _value;
+        uint32_t _link[2];
+
+        uint32_t __child(int side) const;
+        void __set_child(int side, uint32_t child);
+        int __balance() const;
+        void __set_balance(int balance);
+
+        template <typename Value>
+        Node(Value && value);
+    };
+
+    Storage<Node> _nodes;
+    uint32_t _root;
+    uint32_t _free;
+    unsigned _size;
+
+    template <typename Value>
+    bool __insert(Value && value);
+    template <typename Value>
+    uint32_t __allocate(Value && value);
+    void __deallocate(uint32_t node);
+    uint32_t __unlink(const T & value);
+    uint32_t __rotate(uint32_t node, int side);
+    void __relink(const uint32_t path[], const int sides[], int depth, uint32_t subtree);
+    void __retrace_insert(const uint32_t path[], const int sides[], int depth);
+    void __retrace_remove(const uint32_t path[], const int sides[], int depth);
+
+public:
+    Compact_AVL_Tree();
+    explicit Compact_AVL_Tree(const char * path, bool read_only = false);
+    ~Compact_AVL_Tree();
+
+    Compact_AVL_Tree(const Compact_AVL_Tree &) = delete;
+    Compact_AVL_Tree & operator=(const Compact_AVL_Tree &) = delete;
+
+    bool is_open() const;
+    bool flush();
+
+    bool empty();
+    bool insert(const T & value);
+    bool insert(T && value);
+    template <typename... Args>
+    bool emplace(Args &&... args);
+    void reserve(std::size_t count);
+    void clear();
+
+    unsigned size();
+    std::size_t memory_usage() const;
+
+    const T * root() const;
+    const T * find(const T & value) const;
+    bool remove(const T & value);
+    bool extract(const T & value, T & removed);
+};
+
+// TREE
+template <typename T, template <typename> class Storage>
+Compact_AVL_Tree<T, Storage>::Compact_AVL_Tree(): _root(NIL), _free(NIL), _size(0) {}
+
+// Attaches to the nodes kept at path by a file-backed Storage, such as
+// Mapped_Storage; with read_only set, every change fails.
+template <typename T, template <typename> class Storage>
+Compact_AVL_Tree<T, Storage>::Compact_AVL_Tree(const char *path, bool read_only):
+    _nodes(path, read_only), _root(NIL), _free(NIL), _size(0)
+{
+    _nodes.restore(_root, _free, _size);
+}
+
+template <typename T, template <typename> class Storage>
+Compact_AVL_Tree<T, Storage>::~Compact_AVL_Tree()
+{
+    flush();
+}
+
+template <typename T, template <typename> class Storage>
+bool Compact_AVL_Tree<T, Storage>::is_open() const
+{
+    return _nodes.is_open();
+}
+
+// Makes every change so far durable in file-backed storage.
+template <typename T, template <typename> class Storage>
+bool Compact_AVL_Tree<T, Storage>::flush()
+{
+    return _nodes.flush(_root, _free, _size);
+}
+
+template <typename T, template <typename> class Storage>
+bool Compact_AVL_Tree<T, Storage>::empty()
+{
+    return _size == 0;
+}
+
+template <typename T, template <typename> class Storage>
+bool Compact_AVL_Tree<T, Storage>::insert(const T &value)
+{
+    return __insert(value);
+}
+
+template <typename T, template <typename> class Storage>
+bool Compact_AVL_Tree<T, Storage>::insert(T &&value)
+{
+    return __insert(std::move(value));
+}
+
+// The element is built before the search, and moved into its node.
+template <typename T, template <typename> class Storage>
+template <typename... Args>
+bool Compact_AVL_Tree<T, Storage>::emplace(Args &&... args)
+{
+    return __insert(T(std::forward<Args>(args)...));
+}
+
+template <typename T, template <typename> class Storage>
+template <typename Value>
+bool Compact_AVL_Tree<T, Storage>::__insert(Value &&value)
+{
+    uint32_t path[MAX_HEIGHT];
+    int sides[MAX_HEIGHT];
+    int depth = 0;
+    uint32_t node = _root;
+    while(node != NIL)
+    {
+        const Node & current = _nodes[node];
+        int side;
+        if(value < current._value)
+            side = 0;
+        else if(value > current._value)
+            side = 1;
+        else
+            return false;
+        path[depth] = node;
+        sides[depth++] = side;
+        node = current.__child(side);
+    }
+    if(!_nodes.modify())
+        return false;
+    __relink(path, sides, depth, __allocate(std::forward<Value>(value)));
+    _size++;
+    __retrace_insert(path, sides, depth);
+    return true;
+}
+
+template <typename T, template <typename> class Storage>
+void Compact_AVL_Tree<T, Storage>::reserve(std::size_t count)
+{
+    _nodes.reserve(count);
+}
+
+template <typename T, template <typename> class Storage>
+void Compact_AVL_Tree<T, Storage>::clear()
+{
+    if(!_nodes.modify())
+        return;
+    _nodes.clear();
+    _root = NIL;
+    _free = NIL;
+    _size = 0;
+}
+
+template <typename T, template <typename> class Storage>
+unsigned Compact_AVL_Tree<T, Storage>::size()
+{
+    return _size;
+}
+
+template <typename T, template <typename> class Storage>
+std::size_t Compact_AVL_Tree<T, Storage>::memory_usage() const
+{
+    return _nodes.capacity() * sizeof(Node);
+}
+
+// Pointers returned by root() and find() stay valid until the next insert
+// or remove, either of which may move the nodes.
+template <typename T, template <typename> class Storage>
+const T *Compact_AVL_Tree<T, Storage>::root() const
+{
+    if(_root == NIL)
+        return NULL;
+    return &_nodes[_root]._value;
+}
+
+template <typename T, template <typename> class Storage>
+const T *Compact_AVL_Tree<T, Storage>::find(const T &value) const
+{
+    uint32_t node = _root;
+    while(node != NIL)
+    {
+        const Node & current = _nodes[node];
+        if(value < current._value)
+            node = current.__child(0);
+        else if(value > current._value)
+            node = current.__child(1);
+        else
+            return &current._value;
+    }
+    return NULL;
+}
+
+template <typename T, template <typename> class Storage>
+bool Compact_AVL_Tree<T, Storage>::remove(const T &value)
+{
+    uint32_t node = __unlink(value);
+    if(node == NIL)
+        return false;
+    __deallocate(node);
+    return true;
+}
+
+// Like remove, moving the element out into removed.
+template <typename T, template <typename> class Storage>
+bool Compact_AVL_Tree<T, Storage>::extract(const T &value, T &removed)
+{
+    uint32_t node = __unlink(value);
+    if(node == NIL)
+        return false;
+    removed = std::move(_nodes[node]._value);
+    __deallocate(node);
+    return true;
+}
+
+// Takes the element equal to value out of the tree and returns the slot
+// that held it, or NIL; the caller frees the slot. A node with two
+// children takes its successor's value, and the successor, which has no
+// left child, is unlinked instead; the removed element is then moved to
+// that slot.
+template <typename T, template <typename> class Storage>
+uint32_t Compact_AVL_Tree<T, Storage>::__unlink(const T &value)
+{
+    uint32_t path[MAX_HEIGHT];
+    int sides[MAX_HEIGHT];
+    int depth = 0;
+    uint32_t node = _root;
+    while(node != NIL)
+    {
+        const Node & current = _nodes[node];
+        int side;
+        if(value < current._value)
+            side = 0;
+        else if(value > current._value)
+            side = 1;
+        else
+            break;
+        path[depth] = node;
+        sides[depth++] = side;
+        node = current.__child(side);
+    }
+    if(node == NIL || !_nodes.modify())
+        return NIL;
+
+    uint32_t unlinked = node;
+    if(_nodes[node].__child(0) != NIL && _nodes[node].__child(1) != NIL)
+    {
+        path[depth] = node;
+        sides[depth++] = 1;
+        unlinked = _nodes[node].__child(1);
+        while(_nodes[unlinked].__child(0) != NIL)
+        {
+            path[depth] = unlinked;
+            sides[depth++] = 0;
+            unlinked = _nodes[unlinked].__child(0);
+        }
+        using std::swap;
+        swap(_nodes[node]._value, _nodes[unlinked]._value);
+    }
+    const Node & gone = _nodes[unlinked];
+    __relink(path, sides, depth, gone.__child(0) != NIL ? gone.__child(0) : gone.__child(1));
+    _size--;
+    __retrace_remove(path, sides, depth);
+    return unlinked;
+}
+
+// Throws length_error rather than hand out index NIL or one that does not
+// fit in a link.
+template <typename T, template <typename> class Storage>
+template <typename Value>
+uint32_t Compact_AVL_Tree<T, Storage>::__allocate(Value &&value)
+{
+    if(_free == NIL)
+    {
+        if(_nodes.size() >= NIL)
+            throw std::length_error("Compact_AVL_Tree holds at most 2^31 - 1 nodes");
+        _nodes.push_back(Node(std::forward<Value>(value)));
+        return uint32_t(_nodes.size() - 1);
+    }
+    uint32_t node = _free;
+    _free = _nodes[node].__child(0);
+    _nodes[node] = Node(std::forward<Value>(value));
+    return node;
+}
+
+// Moves the value out into a temporary that dies at once, so whatever it
+// owned is released now rather than when the slot is reused; the slot
+// keeps a moved-from T until then. Free for trivially copyable T.
+template <typename T, template <typename> class Storage>
+void Compact_AVL_Tree<T, Storage>::__deallocate(uint32_t node)
+{
+    {
+        T released(std::move(_nodes[node]._value));
+    }
+    _nodes[node]._link[0] = _free;
+    _free = node;
+}
+
+// Lifts the child on the given side above node and returns it. Balance
+// bits are left for the caller to fix.
+template <typename T, template <typename> class Storage>
+uint32_t Compact_AVL_Tree<T, Storage>::__rotate(uint32_t node, int side)
+{
+    uint32_t child = _nodes[node].__child(side);
+    _nodes[node].__set_child(side, _nodes[child].__child(1 - side));
+    _nodes[child].__set_child(1 - side, node);
+    return child;
+}
+
+// Hangs subtree where path[depth - 1] used to point, or at the root.
+template <typename T, template <typename> class Storage>
+void Compact_AVL_Tree<T, Storage>::__relink(const uint32_t path[], const int sides[], int depth, uint32_t subtree)
+{
+    if(depth == 0)
+        _root = subtree;
+    else
+        _nodes[path[depth - 1]].__set_child(sides[depth - 1], subtree);
+}
+
+// The subtree below path[depth - 1] on sides[depth - 1] grew by one level.
+template <typename T, template <typename> class Storage>
+void Compact_AVL_Tree<T, Storage>::__retrace_insert(const uint32_t path[], const int sides[], int depth)
+{
+    while(depth-- > 0)
+    {
+        uint32_t node = path[depth];
+        int side = sides[depth];
+        int taller = side == 0 ? -1 : 1;
+        int balance = _nodes[node].__balance();
+        if(balance == -taller)
+        {
+            _nodes[node].__set_balance(0);
+            return;
+        }
+        if(balance == 0)
+        {
+            _nodes[node].__set_balance(taller);
+            continue;
+        }
+
+        uint32_t child = _nodes[node].__child(side);
+        uint32_t top;
+        if(_nodes[child].__balance() == taller)
+        {
+            top = __rotate(node, side);
+            _nodes[node].__set_balance(0);
+            _nodes[child].__set_balance(0);
+        }
+        else
+        {
+            uint32_t grandchild = _nodes[child].__child(1 - side);
+            int grandchild_balance = _nodes[grandchild].__balance();
+            _nodes[node].__set_child(side, __rotate(child, 1 - side));
+            top = __rotate(node, side);
+            _nodes[node].__set_balance(grandchild_balance == taller ? -taller : 0);
+            _nodes[child].__set_balance(grandchild_balance == -taller ? taller : 0);
+            _nodes[grandchild].__set_balance(0);
+        }
+        __relink(path, sides, depth, top);
+        return;
+    }
+}
+
+// The subtree below path[depth - 1] on sides[depth - 1] shrank by one level.
+template <typename T, template <typename> class Storage>
+void Compact_AVL_Tree<T, Storage>::__retrace_remove(const uint32_t path[], const int sides[], int depth)
+{
+    while(depth-- > 0)
+    {
+        uint32_t node = path[depth];
+        int side = sides[depth];
+        int shorter = side == 0 ? -1 : 1;
+        int balance = _nodes[node].__balance();
+        if(balance == shorter)
+        {
+            _nodes[node].__set_balance(0);
+            continue;
+        }
+        if(balance == 0)
+        {
+            _nodes[node].__set_balance(-shorter);
+            return;
+        }
+
+        uint32_t sibling = _nodes[node].__child(1 - side);
+        int sibling_balance = _nodes[sibling].__balance();
+        uint32_t top;
+        if(sibling_balance == 0)
+        {
+            top = __rotate(node, 1 - side);
+            _nodes[node].__set_balance(-shorter);
+            _nodes[sibling].__set_balance(shorter);
+            __relink(path, sides, depth, top);
+            return;
+        }
+        if(sibling_balance == -shorter)
+        {
+            top = __rotate(node, 1 - side);
+            _nodes[node].__set_balance(0);
+            _nodes[sibling].__set_balance(0);
+        }
+        else
+        {
+            uint32_t nephew = _nodes[sibling].__child(side);
+            int nephew_balance = _nodes[nephew].__balance();
+            _nodes[node].__set_child(1 - side, __rotate(sibling, side));
+            top = __rotate(node, 1 - side);
+            _nodes[node].__set_balance(nephew_balance == -shorter ? shorter : 0);
+            _nodes[sibling].__set_balance(nephew_balance == shorter ? -shorter : 0);
+            _nodes[nephew].__set_balance(0);
+        }
+        __relink(path, sides, depth, top);
+    }
+}
+
+
+// NODE
+template <typename T, template <typename> class Storage>
+template <typename Value>
+Compact_AVL_Tree<T, Storage>::Node::Node(Value &&value): _value(std::forward<Value>(value))
+{
+    _link[0] = NIL;
+    _link[1] = NIL;
+}
+
+template <typename T, template <typename> class Storage>
+uint32_t Compact_AVL_Tree<T, Storage>::Node::__child(int side) const
+{
+    return _link[side] & INDEX_MASK;
+}
+
+template <typename T, template <typename> class Storage>
+void Compact_AVL_Tree<T, Storage>::Node::__set_child(int side, uint32_t child)
+{
+    _link[side] = (_link[side] & HEAVY_BIT) | child;
+}
+
+// -1 when the left subtree is taller, 1 when the right one is.
+template <typename T, template <typename> class Storage>
+int Compact_AVL_Tree<T, Storage>::Node::__balance() const
+{
+    return int(_link[1] >> 31) - int(_link[0] >> 31);
+}
+
+template <typename T, template <typename> class Storage>
+void Compact_AVL_Tree<T, Storage>::Node::__set_balance(int balance)
+{
+    _link[0] = (_link[0] & INDEX_MASK) | (balance < 0 ? HEAVY_BIT : 0);
+    _link[1] = (_link[1] & INDEX_MASK) | (balance > 0 ? HEAVY_BIT : 0);
+}
+
+#endif // COMPACT_AVL_TREE_H
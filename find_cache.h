@@ -0,0 +1,125 @@
+#ifndef FIND_CACHE_H
+#define FIND_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+using std::uint32_t;
+using std::uint64_t;
+
+#include <vector>
+using std::vector;
+
+// Direct-mapped cache of find() results in front of an AVL_Tree of
+// ranges, for workloads where most lookups go to a few hot ranges. A
+// lookup's begin() picks a bucket of 2^bucket_bits addresses, the bucket
+// picks a slot, and the slot remembers the element last found from that
+// bucket. It is used when it still overlaps the lookup and the tree's
+// epoch() has not moved since, which means no node was freed in between;
+// inserts leave it valid. Otherwise the tree is searched and the slot
+// refilled.
+//
+//   Find_Cache<AVL_Tree<NonOverlappingInterval> > cache(tree);
+//   ... cache.find(value) ...
+//   cache.hits(), cache.misses()
+//
+// The hit and miss counts tell whether the cache pays for itself on a
+// workload. It is not thread safe: give each reader its own, and none may
+// outlive the tree.
+template <typename Tree>
+class Find_Cache
+{
+public:
+    typedef typename Tree::const_iterator const_iterator;
+
+private:
+    struct Slot {
+        const_iterator _position;
+        unsigned long _epoch;
+    };
+
+    const Tree & _tree;
+    vector<Slot> _slots;
+    unsigned _bucket_bits;
+    unsigned long long _hits;
+    unsigned long long _misses;
+
+    std::size_t __slot(int address) const;
+
+public:
+    Find_Cache(const Tree & tree, unsigned slots = 256, unsigned bucket_bits = 4);
+
+    template <typename T>
+    const_iterator find(const T & value);
+    void invalidate();
+
+    unsigned long long hits() const;
+    unsigned long long misses() const;
+    void reset_counters();
+};
+
+// slots is rounded up to a power of two.
+template <typename Tree>
+Find_Cache<Tree>::Find_Cache(const Tree &tree, unsigned slots, unsigned bucket_bits):
+    _tree(tree), _bucket_bits(bucket_bits), _hits(0), _misses(0)
+{
+    std::size_t count = 1;
+    while(count < slots)
+        count *= 2;
+    Slot empty = { tree.end(), 0 };
+    _slots.assign(count, empty);
+}
+
+// Same as the tree's find(): an element overlapping value, or end().
+template <typename Tree>
+template <typename T>
+typename Find_Cache<Tree>::const_iterator Find_Cache<Tree>::find(const T &value)
+{
+    Slot & slot = _slots[__slot(value.begin())];
+    if(slot._position != _tree.end() && slot._epoch == _tree.epoch() &&
+       slot._position->begin() <= value.end() && slot._position->end() >= value.begin())
+    {
+        _hits++;
+        return slot._position;
+    }
+    _misses++;
+    slot._position = _tree.find(value);
+    slot._epoch = _tree.epoch();
+    return slot._position;
+}
+
+template <typename Tree>
+void Find_Cache<Tree>::invalidate()
+{
+    for(std::size_t i = 0; i < _slots.size(); i++)
+        _slots[i]._position = _tree.end();
+}
+
+template <typename Tree>
+unsigned long long Find_Cache<Tree>::hits() const
+{
+    return _hits;
+}
+
+template <typename Tree>
+unsigned long long Find_Cache<Tree>::misses() const
+{
+    return _misses;
+}
+
+template <typename Tree>
+void Find_Cache<Tree>::reset_counters()
+{
+    _hits = 0;
+    _misses = 0;
+}
+
+// Fibonacci hashing of the bucket number, so that neighbouring buckets
+// land in different slots.
+template <typename Tree>
+std::size_t Find_Cache<Tree>::__slot(int address) const
+{
+    uint64_t bucket = uint32_t(address) >> _bucket_bits;
+    return std::size_t((bucket * 0x9E3779B97F4A7C15ULL) >> 32) & (_slots.size() - 1);
+}
+
+#endif // FIND_CACHE_H
@@ -0,0 +1,171 @@
+#include "free_gap_avl_tree.h"
+
+static const long long NO_FIT = numeric_limits<long long>::max();
+
+void Free_Gap_Augment::update(Summary &summary, const NonOverlappingInterval &value, const Summary *left, const Summary *right)
+{
+    summary._first = left == NULL ? value.begin() : left->_first;
+    summary._last = right == NULL ? value.end() : right->_last;
+    summary._max_gap = 0;
+    if(left != NULL)
+        summary._max_gap = max(left->_max_gap, (long long)value.begin() - left->_last - 1);
+    if(right != NULL)
+        summary._max_gap = max(summary._max_gap, max(right->_max_gap, (long long)right->_first - value.end() - 1));
+}
+
+Free_Gap_AVL_Tree::Free_Gap_AVL_Tree(int first, int last): _first(first), _last(last)
+{
+    __add_gap(_first, _last);
+}
+
+// Rejects intervals reaching outside the address space, so that every gap
+// lies inside it.
+bool Free_Gap_AVL_Tree::insert(const NonOverlappingInterval &value)
+{
+    if(value.begin() < _first || (long long)value.begin() + value.size() - 1 > _last)
+        return false;
+    if(!Base::insert(value))
+        return false;
+    const_iterator position = lower_bound(value);
+    const_iterator next = position;
+    ++next;
+    long long gap_begin = __gap_begin(position);
+    long long gap_end = __gap_end(next);
+    __remove_gap(gap_begin, gap_end);
+    __add_gap(gap_begin, (long long)value.begin() - 1);
+    __add_gap((long long)value.end() + 1, gap_end);
+    return true;
+}
+
+bool Free_Gap_AVL_Tree::remove(const NonOverlappingInterval &value)
+{
+    NonOverlappingInterval removed = value;
+    if(!Base::extract(value, removed))
+        return false;
+    const_iterator next = lower_bound(removed);
+    long long gap_begin = __gap_begin(next);
+    long long gap_end = __gap_end(next);
+    __remove_gap(gap_begin, (long long)removed.begin() - 1);
+    __remove_gap((long long)removed.end() + 1, gap_end);
+    __add_gap(gap_begin, gap_end);
+    return true;
+}
+
+void Free_Gap_AVL_Tree::clear()
+{
+    Base::clear();
+    _gaps.clear();
+    __add_gap(_first, _last);
+}
+
+const NonOverlappingInterval Free_Gap_AVL_Tree::allocate_first_fit(unsigned size)
+{
+    return allocate_at_or_after(_first, size);
+}
+
+const NonOverlappingInterval Free_Gap_AVL_Tree::allocate_best_fit(unsigned size)
+{
+    if(size == 0)
+        return NonOverlappingInterval::invalid();
+    set<pair<long long, long long> >::iterator gap = _gaps.lower_bound(make_pair((long long)size, numeric_limits<long long>::min()));
+    if(gap == _gaps.end())
+        return NonOverlappingInterval::invalid();
+    const NonOverlappingInterval allocated(int(gap->second), size);
+    insert(allocated);
+    return allocated;
+}
+
+// Lowest range of size units starting at address or later: the gap in
+// front of the first interval, then the gaps inside the tree, then the one
+// after the last interval.
+const NonOverlappingInterval Free_Gap_AVL_Tree::allocate_at_or_after(int address, unsigned size)
+{
+    if(size == 0)
+        return NonOverlappingInterval::invalid();
+    long long start = max((long long)address, (long long)_first);
+    long long found = NO_FIT;
+    if(_root == NULL)
+    {
+        if(_last - start + 1 >= (long long)size)
+            found = start;
+    }
+    else if(_root->_summary._first - start >= (long long)size)
+        found = start;
+    else
+    {
+        found = __fit(_root, start, size);
+        if(found == NO_FIT)
+        {
+            long long tail = max(start, (long long)_root->_summary._last + 1);
+            if(_last - tail + 1 >= (long long)size)
+                found = tail;
+        }
+    }
+    if(found == NO_FIT)
+        return NonOverlappingInterval::invalid();
+    const NonOverlappingInterval allocated(int(found), size);
+    insert(allocated);
+    return allocated;
+}
+
+long long Free_Gap_AVL_Tree::largest_gap()
+{
+    if(_gaps.empty())
+        return 0;
+    return _gaps.rbegin()->first;
+}
+
+void Free_Gap_AVL_Tree::__add_gap(long long begin, long long end)
+{
+    if(end >= begin)
+        _gaps.insert(make_pair(end - begin + 1, begin));
+}
+
+void Free_Gap_AVL_Tree::__remove_gap(long long begin, long long end)
+{
+    if(end >= begin)
+        _gaps.erase(make_pair(end - begin + 1, begin));
+}
+
+// First free unit of the gap that ends just before next.
+long long Free_Gap_AVL_Tree::__gap_begin(const_iterator next)
+{
+    if(next == begin())
+        return _first;
+    --next;
+    return (long long)next->end() + 1;
+}
+
+// Last free unit of the gap that ends just before next.
+long long Free_Gap_AVL_Tree::__gap_end(const_iterator next)
+{
+    if(next == end())
+        return _last;
+    return (long long)next->begin() - 1;
+}
+
+// Lowest start at or after address for size units inside one of the gaps
+// between the intervals of root's subtree. Subtrees without a large
+// enough gap, or ending before address, are skipped whole, so at most one
+// path fails before the search commits to a subtree that must succeed.
+long long Free_Gap_AVL_Tree::__fit(Node *root, long long address, unsigned size)
+{
+    if(root == NULL || root->_summary._max_gap < (long long)size || root->_summary._last < address)
+        return NO_FIT;
+    if(root->_left != NULL)
+    {
+        long long found = __fit(root->_left, address, size);
+        if(found != NO_FIT)
+            return found;
+        long long start = max((long long)root->_left->_summary._last + 1, address);
+        if(root->_value.begin() - start >= (long long)size)
+            return start;
+    }
+    if(root->_right != NULL)
+    {
+        long long start = max((long long)root->_value.end() + 1, address);
+        if(root->_right->_summary._first - start >= (long long)size)
+            return start;
+    }
+    return __fit(root->_right, address, size);
+}
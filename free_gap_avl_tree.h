@@ -0,0 +1,69 @@
+#ifndef FREE_GAP_AVL_TREE_H
+#define FREE_GAP_AVL_TREE_H
+
+#include <set>
+using std::set;
+
+#include "avl_tree.h"
+#include "interval.h"
+
+// Summary of a subtree of disjoint intervals: where it starts, where it
+// ends, and the largest run of free units between two of its intervals.
+struct Free_Gap_Augment {
+    struct Summary {
+        int _first;
+        int _last;
+        long long _max_gap;
+    };
+    static const bool ENABLED = true;
+    static void update(Summary & summary, const NonOverlappingInterval & value, const Summary * left, const Summary * right);
+};
+
+// Address-space allocator over [first, last]. Allocated ranges are kept in
+// an AVL_Tree augmented with Free_Gap_Augment, which lets first-fit and
+// at-or-after searches skip every subtree without a large enough gap. Best
+// fit goes through a second index of the gaps ordered by size. All three
+// run in O(log n), and fail by returning NonOverlappingInterval::invalid().
+class Free_Gap_AVL_Tree : private AVL_Tree<NonOverlappingInterval, allocator<NonOverlappingInterval>, Free_Gap_Augment>
+{
+    typedef AVL_Tree<NonOverlappingInterval, allocator<NonOverlappingInterval>, Free_Gap_Augment> Base;
+
+    int _first;
+    int _last;
+    set<pair<long long, long long> > _gaps;
+
+    void __add_gap(long long begin, long long end);
+    void __remove_gap(long long begin, long long end);
+    long long __gap_begin(const_iterator position);
+    long long __gap_end(const_iterator position);
+    long long __fit(Node * root, long long address, unsigned size);
+
+public:
+    typedef Base::const_iterator const_iterator;
+    typedef Base::iterator iterator;
+
+    Free_Gap_AVL_Tree(int first, int last);
+
+    using Base::empty;
+    using Base::size;
+    using Base::root;
+    using Base::find;
+    using Base::check;
+    using Base::begin;
+    using Base::end;
+    using Base::lower_bound;
+    using Base::upper_bound;
+    using Base::for_each_in_range;
+
+    bool insert(const NonOverlappingInterval & value);
+    bool remove(const NonOverlappingInterval & value);
+    void clear();
+
+    const NonOverlappingInterval allocate_first_fit(unsigned size);
+    const NonOverlappingInterval allocate_best_fit(unsigned size);
+    const NonOverlappingInterval allocate_at_or_after(int address, unsigned size);
+
+    long long largest_gap();
+};
+
+#endif // FREE_GAP_AVL_TREE_H
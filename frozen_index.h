@@ -0,0 +1,245 @@
+#ifndef FROZEN_INDEX_H
+#define FROZEN_INDEX_H
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+using std::uint32_t;
+
+#include <utility>
+
+#include <vector>
+using std::vector;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Read-only copy of a tree of disjoint ranges, built for lookups. The end()
+// of every range sits in a static search tree of 64-byte blocks, each
+// holding 16 keys in order with 17 children laid out implicitly, so a
+// lookup loads one cache line per level, about log17 n of them, and
+// compares all 16 keys of a block at once with AVX2 or SSE2, or a scalar
+// loop elsewhere. T must expose begin() and end(), and the ranges must be
+// handed over in ascending order.
+//
+//   Frozen_Index<NonOverlappingInterval> index = freeze(tree);
+//   const NonOverlappingInterval * found = index.find(address);
+template <typename T>
+class Frozen_Index
+{
+    static const int BLOCK = 16;
+    static const std::size_t CACHE_LINE = 64;
+    static const uint32_t PADDING = 0xFFFFFFFF;
+
+    vector<T> _values;
+    // Keys of block k start at _keys + k * BLOCK; the vector has slack so
+    // that _keys can start on a cache line.
+    vector<int> _key_storage;
+    int * _keys;
+    // Position in _values of every key, PADDING past the last range.
+    vector<uint32_t> _positions;
+    std::size_t _blocks;
+
+    static std::size_t __child(std::size_t block, int slot);
+    static int __rank(const int * keys, int key);
+    void __build(std::size_t block, std::size_t & next);
+    const T * __successor(int key) const;
+
+public:
+    Frozen_Index();
+    template <typename Forward_Iterator>
+    Frozen_Index(Forward_Iterator first, Forward_Iterator last);
+
+    Frozen_Index(Frozen_Index && o);
+    Frozen_Index & operator=(Frozen_Index && o);
+
+    Frozen_Index(const Frozen_Index &) = delete;
+    Frozen_Index & operator=(const Frozen_Index &) = delete;
+
+    bool empty() const;
+    std::size_t size() const;
+    std::size_t memory_usage() const;
+
+    const T * find(const T & value) const;
+    const T * find(int address) const;
+
+    const T * begin() const;
+    const T * end() const;
+};
+
+template <typename T>
+Frozen_Index<T>::Frozen_Index(): _keys(NULL), _blocks(0) {}
+
+template <typename T>
+template <typename Forward_Iterator>
+Frozen_Index<T>::Frozen_Index(Forward_Iterator first, Forward_Iterator last):
+    _values(first, last), _keys(NULL), _blocks((_values.size() + BLOCK - 1) / BLOCK)
+{
+    if(_blocks == 0)
+        return;
+    _key_storage.resize(_blocks * BLOCK + CACHE_LINE / sizeof(int));
+    std::size_t misalignment = reinterpret_cast<std::uintptr_t>(_key_storage.data()) % CACHE_LINE;
+    _keys = _key_storage.data() + (misalignment == 0 ? 0 : (CACHE_LINE - misalignment) / sizeof(int));
+    _positions.resize(_blocks * BLOCK);
+    std::size_t next = 0;
+    __build(0, next);
+}
+
+template <typename T>
+Frozen_Index<T>::Frozen_Index(Frozen_Index &&o):
+    _values(std::move(o._values)), _key_storage(std::move(o._key_storage)), _keys(o._keys),
+    _positions(std::move(o._positions)), _blocks(o._blocks)
+{
+    o._keys = NULL;
+    o._blocks = 0;
+}
+
+template <typename T>
+Frozen_Index<T> &Frozen_Index<T>::operator=(Frozen_Index &&o)
+{
+    if(this != &o)
+    {
+        _values = std::move(o._values);
+        _key_storage = std::move(o._key_storage);
+        _keys = o._keys;
+        _positions = std::move(o._positions);
+        _blocks = o._blocks;
+        o._keys = NULL;
+        o._blocks = 0;
+    }
+    return *this;
+}
+
+template <typename T>
+bool Frozen_Index<T>::empty() const
+{
+    return _values.empty();
+}
+
+template <typename T>
+std::size_t Frozen_Index<T>::size() const
+{
+    return _values.size();
+}
+
+template <typename T>
+std::size_t Frozen_Index<T>::memory_usage() const
+{
+    return _values.capacity() * sizeof(T) + _key_storage.capacity() * sizeof(int) +
+           _positions.capacity() * sizeof(uint32_t);
+}
+
+// The stored range overlapping value, or NULL. Ranges are disjoint, so the
+// first one ending at or after value.begin() is the only candidate.
+template <typename T>
+const T *Frozen_Index<T>::find(const T &value) const
+{
+    const T * found = __successor(value.begin());
+    if(found == NULL || found->begin() > value.end())
+        return NULL;
+    return found;
+}
+
+// The stored range containing address, or NULL.
+template <typename T>
+const T *Frozen_Index<T>::find(int address) const
+{
+    const T * found = __successor(address);
+    if(found == NULL || found->begin() > address)
+        return NULL;
+    return found;
+}
+
+template <typename T>
+const T *Frozen_Index<T>::begin() const
+{
+    return _values.data();
+}
+
+template <typename T>
+const T *Frozen_Index<T>::end() const
+{
+    return _values.data() + _values.size();
+}
+
+template <typename T>
+std::size_t Frozen_Index<T>::__child(std::size_t block, int slot)
+{
+    return block * (BLOCK + 1) + slot + 1;
+}
+
+// Number of keys of the block less than key, which is where key would go,
+// since the keys of a block are sorted.
+template <typename T>
+int Frozen_Index<T>::__rank(const int *keys, int key)
+{
+#if defined(__AVX2__)
+    __m256i probe = _mm256_set1_epi32(key);
+    __m256i low = _mm256_cmpgt_epi32(probe, _mm256_load_si256(reinterpret_cast<const __m256i *>(keys)));
+    __m256i high = _mm256_cmpgt_epi32(probe, _mm256_load_si256(reinterpret_cast<const __m256i *>(keys + 8)));
+    unsigned mask = unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(low))) |
+                    unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(high))) << 8;
+    return __builtin_popcount(mask);
+#elif defined(__SSE2__)
+    __m128i probe = _mm_set1_epi32(key);
+    unsigned mask = 0;
+    for(int i = 0; i < BLOCK; i += 4)
+    {
+        __m128i less = _mm_cmpgt_epi32(probe, _mm_load_si128(reinterpret_cast<const __m128i *>(keys + i)));
+        mask |= unsigned(_mm_movemask_ps(_mm_castsi128_ps(less))) << i;
+    }
+    return __builtin_popcount(mask);
+#else
+    int rank = 0;
+    for(int i = 0; i < BLOCK; i++)
+        rank += keys[i] < key;
+    return rank;
+#endif
+}
+
+// Fills the blocks in order: the subtree left of every key, the key, and
+// after the last key the rightmost subtree. Keys past the last range are
+// INT_MAX, which keeps every block sorted.
+template <typename T>
+void Frozen_Index<T>::__build(std::size_t block, std::size_t &next)
+{
+    if(block >= _blocks)
+        return;
+    int * keys = _keys + block * BLOCK;
+    for(int i = 0; i < BLOCK; i++)
+    {
+        __build(__child(block, i), next);
+        keys[i] = next < _values.size() ? _values[next].end() : INT_MAX;
+        _positions[block * BLOCK + i] = next < _values.size() ? uint32_t(next++) : PADDING;
+    }
+    __build(__child(block, BLOCK), next);
+}
+
+// First range ending at or after key. Each level narrows the search to one
+// child; the smallest key at or above key seen on the way is the answer.
+// A padding key can only be chosen when no range qualifies.
+template <typename T>
+const T *Frozen_Index<T>::__successor(int key) const
+{
+    uint32_t position = PADDING;
+    for(std::size_t block = 0; block < _blocks; )
+    {
+        int slot = __rank(_keys + block * BLOCK, key);
+        if(slot < BLOCK)
+            position = _positions[block * BLOCK + slot];
+        block = __child(block, slot);
+    }
+    return position == PADDING ? NULL : &_values[position];
+}
+
+// Read-only copy of a tree that changes rarely: lookups in it touch about
+// log17 n cache lines instead of log2 n nodes. Only for ranges ordered by
+// address, as the index orders them by end().
+template <typename Tree>
+Frozen_Index<typename Tree::const_iterator::value_type> freeze(const Tree & tree)
+{
+    return Frozen_Index<typename Tree::const_iterator::value_type>(tree.begin(), tree.end());
+}
+
+#endif // FROZEN_INDEX_H
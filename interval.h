@@ -19,6 +19,7 @@ class NonOverlappingInterval
     static const NonOverlappingInterval _INVALID;
 public:
     NonOverlappingInterval(int begin, unsigned size);
+    int compare(const NonOverlappingInterval & o) const;
     bool operator==(const NonOverlappingInterval & o) const;
     bool operator<(const NonOverlappingInterval & o) const;
     bool operator>(const NonOverlappingInterval & o) const;
@@ -35,4 +36,44 @@ public:
 
 };
 
+// Ordering is inline so that a tree descent does not make an out-of-line
+// call per level. Overlapping intervals compare equal.
+inline int NonOverlappingInterval::compare(const NonOverlappingInterval &o) const
+{
+    if(end() < o._begin)
+        return -1;
+    return _begin > o.end() ? 1 : 0;
+}
+
+inline bool NonOverlappingInterval::operator==(const NonOverlappingInterval &o) const
+{
+    return (_begin >= o._begin && _begin <= o.end()) ||
+           (end() >= o._begin && end() <= o.end());
+}
+
+inline bool NonOverlappingInterval::operator<(const NonOverlappingInterval &o) const
+{
+    return end() < o._begin;
+}
+
+inline bool NonOverlappingInterval::operator>(const NonOverlappingInterval &o) const
+{
+    return _begin > o.end();
+}
+
+inline int NonOverlappingInterval::begin() const
+{
+    return _begin;
+}
+
+inline unsigned NonOverlappingInterval::size() const
+{
+    return _size;
+}
+
+inline int NonOverlappingInterval::end() const
+{
+    return int(_begin + _size - 1);
+}
+
 #endif // INTERVAL_H
@@ -0,0 +1,73 @@
+#include "interval_set.h"
+
+#include <algorithm>
+using std::min;
+
+// Returns false and changes nothing if range is already covered, or if the
+// merged range would not fit in one NonOverlappingInterval.
+bool Interval_Set::insert(const NonOverlappingInterval &range)
+{
+    long long first = range.begin();
+    long long last = range.end();
+    const_iterator low = Base::lower_bound(__unit(first - 1));
+    if(low == Base::end() || low->begin() > last + 1)
+        return Base::insert(range);
+    const_iterator high = Base::upper_bound(__unit(last + 1));
+    --high;
+    if(low == high && low->begin() <= first && low->end() >= last)
+        return false;
+    first = min(first, (long long)low->begin());
+    last = max(last, (long long)high->end());
+    if(last - first + 1 > numeric_limits<unsigned>::max())
+        return false;
+    __cut(first, last);
+    return Base::insert(NonOverlappingInterval(int(first), unsigned(last - first + 1)));
+}
+
+// The ranges at either end may reach outside range; what is left of them
+// goes back in as at most two smaller ranges.
+bool Interval_Set::erase(const NonOverlappingInterval &range)
+{
+    long long first = range.begin();
+    long long last = range.end();
+    const_iterator low = Base::lower_bound(__unit(first));
+    if(low == Base::end() || low->begin() > last)
+        return false;
+    const_iterator high = Base::upper_bound(__unit(last));
+    --high;
+    long long head = low->begin();
+    long long tail = high->end();
+    __cut(head, tail);
+    if(head < first)
+        Base::insert(NonOverlappingInterval(int(head), unsigned(first - head)));
+    if(tail > last)
+        Base::insert(NonOverlappingInterval(int(last + 1), unsigned(tail - last)));
+    return true;
+}
+
+bool Interval_Set::contains(int address) const
+{
+    return Base::find(NonOverlappingInterval(address, 1)) != Base::end();
+}
+
+// Single unit at address, clamped to the int range so that the neighbours
+// of the first and last addresses can be probed.
+const NonOverlappingInterval Interval_Set::__unit(long long address)
+{
+    address = max(address, (long long)numeric_limits<int>::min());
+    address = min(address, (long long)numeric_limits<int>::max());
+    return NonOverlappingInterval(int(address), 1);
+}
+
+// Drops every stored range lying inside [first, last], which no stored
+// range may straddle: the tree is split on both sides of it and the outer
+// parts joined back.
+void Interval_Set::__cut(long long first, long long last)
+{
+    Base middle = Base::split(__unit(first));
+    if(last < numeric_limits<int>::max())
+    {
+        Base right = middle.split(__unit(last + 1));
+        Base::join(right);
+    }
+}
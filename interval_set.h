@@ -0,0 +1,41 @@
+#ifndef INTERVAL_SET_H
+#define INTERVAL_SET_H
+
+#include "avl_tree.h"
+#include "interval.h"
+
+// Set of addresses stored as an AVL_Tree of disjoint ranges. insert()
+// merges a range with every stored range it overlaps or touches, and
+// erase() trims or splits the ranges it partially covers, so no two stored
+// ranges are ever adjacent: [0,9] and [10,19] are kept as [0,19]. Both cut
+// the affected ranges out with split() and join() and cost O(log n + k)
+// for k ranges merged or removed.
+class Interval_Set : private AVL_Tree<NonOverlappingInterval>
+{
+    typedef AVL_Tree<NonOverlappingInterval> Base;
+
+    static const NonOverlappingInterval __unit(long long address);
+    void __cut(long long first, long long last);
+
+public:
+    typedef Base::const_iterator const_iterator;
+    typedef Base::iterator iterator;
+
+    using Base::empty;
+    using Base::size;
+    using Base::root;
+    using Base::find;
+    using Base::check;
+    using Base::begin;
+    using Base::end;
+    using Base::lower_bound;
+    using Base::upper_bound;
+    using Base::for_each_in_range;
+    using Base::clear;
+
+    bool insert(const NonOverlappingInterval & range);
+    bool erase(const NonOverlappingInterval & range);
+    bool contains(int address) const;
+};
+
+#endif // INTERVAL_SET_H
@@ -0,0 +1,29 @@
+#include "interval_tree.h"
+
+void Max_End_Augment::update(Summary &summary, const NonOverlappingInterval &value, const Summary *left, const Summary *right)
+{
+    summary._max_end = value.end();
+    if(left != NULL)
+        summary._max_end = max(summary._max_end, left->_max_end);
+    if(right != NULL)
+        summary._max_end = max(summary._max_end, right->_max_end);
+}
+
+// One stored range intersecting query, or end(). If the left subtree
+// reaches query.begin() and holds nothing intersecting query, then every
+// range in it begins after query.end(), and so does every range to its
+// right; so the search only ever goes down one side.
+Interval_Tree::const_iterator Interval_Tree::any_overlap(const NonOverlappingInterval &query) const
+{
+    Node * node = _root;
+    while(node != NULL)
+    {
+        if(node->_value.begin() <= query.end() && node->_value.end() >= query.begin())
+            return __iterator(node);
+        if(node->_left != NULL && node->_left->_summary._max_end >= query.begin())
+            node = node->_left;
+        else
+            node = node->_right;
+    }
+    return end();
+}
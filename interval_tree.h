@@ -0,0 +1,95 @@
+#ifndef INTERVAL_TREE_H
+#define INTERVAL_TREE_H
+
+#include "avl_tree.h"
+#include "interval.h"
+
+// Orders ranges by begin(), then by end(), so that overlapping ranges are
+// distinct elements; only identical ranges compare equal.
+struct Begin_End_Compare {
+    static int compare(const NonOverlappingInterval & a, const NonOverlappingInterval & b);
+};
+
+// Largest end() in a subtree, which tells a search whether anything below
+// can still reach the query.
+struct Max_End_Augment {
+    struct Summary {
+        int _max_end;
+    };
+    static const bool ENABLED = true;
+    static void update(Summary & summary, const NonOverlappingInterval & value, const Summary * left, const Summary * right);
+};
+
+// Interval tree over ranges that may overlap, such as reservations. The
+// ranges sit in an AVL_Tree ordered by Begin_End_Compare and augmented
+// with Max_End_Augment, kept up to date through rotations like any other
+// summary. any_overlap() follows a single path down, O(log n). overlaps()
+// skips every subtree that ends before the query or starts after it, but
+// a subtree that reaches the query may still hold only a few matches deep
+// down, so reporting k ranges costs O(min(n, k log n)). The same range can
+// be stored only once.
+class Interval_Tree : private AVL_Tree<NonOverlappingInterval, allocator<NonOverlappingInterval>, Max_End_Augment, No_Stats, Begin_End_Compare>
+{
+    typedef AVL_Tree<NonOverlappingInterval, allocator<NonOverlappingInterval>, Max_End_Augment, No_Stats, Begin_End_Compare> Base;
+
+    template <typename Output_Iterator>
+    static unsigned __overlaps(const Node * node, const NonOverlappingInterval & query, Output_Iterator & found);
+
+public:
+    typedef Base::const_iterator const_iterator;
+    typedef Base::iterator iterator;
+
+    using Base::empty;
+    using Base::size;
+    using Base::root;
+    using Base::check;
+    using Base::begin;
+    using Base::end;
+    using Base::insert;
+    using Base::remove;
+    using Base::clear;
+
+    const_iterator any_overlap(const NonOverlappingInterval & query) const;
+    template <typename Output_Iterator>
+    unsigned overlaps(const NonOverlappingInterval & query, Output_Iterator found) const;
+};
+
+inline int Begin_End_Compare::compare(const NonOverlappingInterval &a, const NonOverlappingInterval &b)
+{
+    if(a.begin() != b.begin())
+        return a.begin() < b.begin() ? -1 : 1;
+    if(a.end() != b.end())
+        return a.end() < b.end() ? -1 : 1;
+    return 0;
+}
+
+// Writes every stored range intersecting query to found, in ascending
+// order, and returns how many there were.
+template <typename Output_Iterator>
+unsigned Interval_Tree::overlaps(const NonOverlappingInterval &query, Output_Iterator found) const
+{
+    return __overlaps(_root, query, found);
+}
+
+// In order, so the output comes out sorted. Nothing right of a node that
+// begins after the query can intersect it.
+template <typename Output_Iterator>
+unsigned Interval_Tree::__overlaps(const Node *node, const NonOverlappingInterval &query, Output_Iterator &found)
+{
+    unsigned count = 0;
+    while(node != NULL && node->_summary._max_end >= query.begin())
+    {
+        count += __overlaps(node->_left, query, found);
+        if(node->_value.begin() > query.end())
+            break;
+        if(node->_value.end() >= query.begin())
+        {
+            *found++ = node->_value;
+            count++;
+        }
+        node = node->_right;
+    }
+    return count;
+}
+
+#endif // INTERVAL_TREE_H
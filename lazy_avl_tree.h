@@ -0,0 +1,346 @@
+#ifndef LAZY_AVL_TREE_H
+#define LAZY_AVL_TREE_H
+
+#include <cstddef>
+
+#include <utility>
+
+#include <vector>
+using std::vector;
+
+#include "avl_tree.h"
+
+// Element of a Lazy_AVL_Tree: the value and whether it was removed. The
+// mark is mutable so that removing does not touch the tree's shape.
+template <typename T>
+struct Lazy_Element {
+    T _value;
+    mutable bool _dead;
+
+    explicit Lazy_Element(const T & value);
+    explicit Lazy_Element(T && value);
+    int compare(const Lazy_Element & o) const;
+};
+
+// Number of live elements in a subtree, which lets lookups skip subtrees
+// holding only removed ones.
+template <typename T>
+struct Live_Count_Augment {
+    struct Summary {
+        unsigned _live;
+    };
+    static const bool ENABLED = true;
+    static void update(Summary & summary, const Lazy_Element<T> & value, const Summary * left, const Summary * right);
+};
+
+// AVL tree for workloads that remove elements in bursts. remove() only
+// marks the element dead and updates the live counts on its path, O(log n)
+// with no rotation; lookups and iteration skip dead elements. compact()
+// drops the dead nodes and relinks the live ones into a balanced tree in
+// O(n), without copying or allocating. It runs by itself once dead
+// elements pass dead_fraction of the nodes, or can be called at a quiet
+// moment; with a dead_fraction of 1 it only runs when called.
+template <typename T>
+class Lazy_AVL_Tree : private AVL_Tree<Lazy_Element<T>, allocator<Lazy_Element<T> >, Live_Count_Augment<T> >
+{
+    typedef Lazy_Element<T> Element;
+    typedef AVL_Tree<Element, allocator<Element>, Live_Count_Augment<T> > Base;
+    typedef typename Base::Node Node;
+
+    // Fewest dead elements that trigger a compaction, so that a few
+    // removes from a small tree do not rebuild it every time.
+    static const unsigned MIN_COMPACTION = 64;
+
+    double _dead_fraction;
+    unsigned _dead;
+
+    bool __insert(Element && element);
+    Node * __find_live(Node * root, const T & value) const;
+    Node * __relink(Node ** nodes, std::size_t count);
+
+public:
+    class const_iterator {
+        friend class Lazy_AVL_Tree;
+        typename Base::const_iterator _position;
+        typename Base::const_iterator _end;
+        const_iterator(typename Base::const_iterator position, typename Base::const_iterator end);
+        void __skip_dead();
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T * pointer;
+        typedef const T & reference;
+
+        reference operator*() const;
+        pointer operator->() const;
+        const_iterator & operator++();
+        const_iterator operator++(int);
+        bool operator==(const const_iterator & o) const;
+        bool operator!=(const const_iterator & o) const;
+    };
+
+    explicit Lazy_AVL_Tree(double dead_fraction = 0.25);
+
+    bool empty() const;
+    unsigned size() const;
+    unsigned dead() const;
+
+    bool insert(const T & value);
+    bool insert(T && value);
+    bool remove(const T & value);
+    bool check(const T & value) const;
+    const T * find(const T & value) const;
+    void compact();
+    void clear();
+
+    const_iterator begin() const;
+    const_iterator end() const;
+};
+
+template <typename T>
+Lazy_Element<T>::Lazy_Element(const T &value): _value(value), _dead(false) {}
+
+template <typename T>
+Lazy_Element<T>::Lazy_Element(T &&value): _value(std::move(value)), _dead(false) {}
+
+template <typename T>
+int Lazy_Element<T>::compare(const Lazy_Element &o) const
+{
+    return Three_Way_Compare<T>::compare(_value, o._value);
+}
+
+template <typename T>
+void Live_Count_Augment<T>::update(Summary &summary, const Lazy_Element<T> &value, const Summary *left, const Summary *right)
+{
+    summary._live = (value._dead ? 0 : 1) + (left == NULL ? 0 : left->_live) + (right == NULL ? 0 : right->_live);
+}
+
+// TREE
+template <typename T>
+Lazy_AVL_Tree<T>::Lazy_AVL_Tree(double dead_fraction): _dead_fraction(dead_fraction), _dead(0) {}
+
+template <typename T>
+bool Lazy_AVL_Tree<T>::empty() const
+{
+    return size() == 0;
+}
+
+template <typename T>
+unsigned Lazy_AVL_Tree<T>::size() const
+{
+    return Base::_root == NULL ? 0 : Base::_root->_summary._live;
+}
+
+template <typename T>
+unsigned Lazy_AVL_Tree<T>::dead() const
+{
+    return _dead;
+}
+
+template <typename T>
+bool Lazy_AVL_Tree<T>::insert(const T &value)
+{
+    return __insert(Element(value));
+}
+
+template <typename T>
+bool Lazy_AVL_Tree<T>::insert(T &&value)
+{
+    return __insert(Element(std::move(value)));
+}
+
+template <typename T>
+bool Lazy_AVL_Tree<T>::remove(const T &value)
+{
+    Node * node = __find_live(Base::_root, value);
+    if(node == NULL)
+        return false;
+    node->_value._dead = true;
+    for(; node != NULL; node = node->_parent)
+        node->__update_height();
+    _dead++;
+    if(_dead >= MIN_COMPACTION && _dead > _dead_fraction * Base::_size)
+        compact();
+    return true;
+}
+
+template <typename T>
+bool Lazy_AVL_Tree<T>::check(const T &value) const
+{
+    return find(value) != NULL;
+}
+
+// A live element equal to value, or NULL.
+template <typename T>
+const T *Lazy_AVL_Tree<T>::find(const T &value) const
+{
+    Node * node = __find_live(Base::_root, value);
+    return node == NULL ? NULL : &node->_value._value;
+}
+
+template <typename T>
+void Lazy_AVL_Tree<T>::compact()
+{
+    if(_dead == 0)
+        return;
+    vector<Node *> live;
+    live.reserve(size());
+    vector<Node *> stack;
+    for(Node * node = Base::_root; node != NULL || !stack.empty(); )
+    {
+        if(node != NULL)
+        {
+            stack.push_back(node);
+            node = node->_left;
+            continue;
+        }
+        node = stack.back();
+        stack.pop_back();
+        Node * right = node->_right;
+        if(node->_value._dead)
+            Base::__destroy(node);
+        else
+            live.push_back(node);
+        node = right;
+    }
+    Base::_root = __relink(live.data(), live.size());
+    if(Base::_root != NULL)
+        Base::_root->_parent = NULL;
+    Base::_size = live.size();
+    _dead = 0;
+}
+
+template <typename T>
+void Lazy_AVL_Tree<T>::clear()
+{
+    Base::clear();
+    _dead = 0;
+}
+
+template <typename T>
+typename Lazy_AVL_Tree<T>::const_iterator Lazy_AVL_Tree<T>::begin() const
+{
+    return const_iterator(Base::begin(), Base::end());
+}
+
+template <typename T>
+typename Lazy_AVL_Tree<T>::const_iterator Lazy_AVL_Tree<T>::end() const
+{
+    return const_iterator(Base::end(), Base::end());
+}
+
+// Dead elements in the way are dropped for good first, so that they do
+// not keep element out; element itself serves as the key to remove them.
+template <typename T>
+bool Lazy_AVL_Tree<T>::__insert(Element &&element)
+{
+    if(__find_live(Base::_root, element._value) != NULL)
+        return false;
+    while(Base::remove(element))
+        _dead--;
+    return Base::insert(std::move(element));
+}
+
+// Elements equal to value are contiguous in order, and any of them may be
+// dead, so below the first one met both sides are searched; subtrees
+// without live elements are skipped. value is compared as it is, without
+// being wrapped in an Element.
+template <typename T>
+typename Lazy_AVL_Tree<T>::Node *Lazy_AVL_Tree<T>::__find_live(Node *root, const T &value) const
+{
+    while(root != NULL && root->_summary._live != 0)
+    {
+        int order = Three_Way_Compare<T>::compare(value, root->_value._value);
+        if(order < 0)
+            root = root->_left;
+        else if(order > 0)
+            root = root->_right;
+        else if(!root->_value._dead)
+            return root;
+        else
+        {
+            Node * found = __find_live(root->_left, value);
+            if(found != NULL)
+                return found;
+            root = root->_right;
+        }
+    }
+    return NULL;
+}
+
+// Balanced subtree out of count nodes in order, as AVL_Tree::__build does
+// with values.
+template <typename T>
+typename Lazy_AVL_Tree<T>::Node *Lazy_AVL_Tree<T>::__relink(Node **nodes, std::size_t count)
+{
+    if(count == 0)
+        return NULL;
+    std::size_t middle = count / 2;
+    Node * root = nodes[middle];
+    root->_left = __relink(nodes, middle);
+    root->_right = __relink(nodes + middle + 1, count - middle - 1);
+    if(root->_left != NULL)
+        root->_left->_parent = root;
+    if(root->_right != NULL)
+        root->_right->_parent = root;
+    root->__update_height();
+    return root;
+}
+
+// ITERATOR
+template <typename T>
+Lazy_AVL_Tree<T>::const_iterator::const_iterator(typename Base::const_iterator position, typename Base::const_iterator end):
+    _position(position), _end(end)
+{
+    __skip_dead();
+}
+
+template <typename T>
+void Lazy_AVL_Tree<T>::const_iterator::__skip_dead()
+{
+    while(_position != _end && _position->_dead)
+        ++_position;
+}
+
+template <typename T>
+typename Lazy_AVL_Tree<T>::const_iterator::reference Lazy_AVL_Tree<T>::const_iterator::operator*() const
+{
+    return _position->_value;
+}
+
+template <typename T>
+typename Lazy_AVL_Tree<T>::const_iterator::pointer Lazy_AVL_Tree<T>::const_iterator::operator->() const
+{
+    return &_position->_value;
+}
+
+template <typename T>
+typename Lazy_AVL_Tree<T>::const_iterator &Lazy_AVL_Tree<T>::const_iterator::operator++()
+{
+    ++_position;
+    __skip_dead();
+    return *this;
+}
+
+template <typename T>
+typename Lazy_AVL_Tree<T>::const_iterator Lazy_AVL_Tree<T>::const_iterator::operator++(int)
+{
+    const_iterator previous = *this;
+    ++*this;
+    return previous;
+}
+
+template <typename T>
+bool Lazy_AVL_Tree<T>::const_iterator::operator==(const const_iterator &o) const
+{
+    return _position == o._position;
+}
+
+template <typename T>
+bool Lazy_AVL_Tree<T>::const_iterator::operator!=(const const_iterator &o) const
+{
+    return _position != o._position;
+}
+
+#endif // LAZY_AVL_TREE_H
@@ -0,0 +1,311 @@
+#ifndef MAPPED_STORAGE_H
+#define MAPPED_STORAGE_H
+
+#include <cstddef>
+#include <cstdint>
+using std::uint32_t;
+
+#include <new>
+
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Node storage for Compact_AVL_Tree kept in a file mapped with mmap. The
+// tree links its nodes by index, so the file can be mapped at any address
+// and attaching to it costs one mmap, however large it is; the page cache
+// decides what stays resident. Several processes can map the same file
+// read-only.
+//
+//   Compact_AVL_Tree<T, Mapped_Storage> tree("index.avl");
+//   ...
+//   tree.flush();
+//
+// Changes land in the mapping as they are made and reach the disk at
+// flush() or when the tree is destroyed. The file is marked dirty before
+// the first change after a flush, and a dirty file is refused when
+// opened, since it may hold a half-written update. T must be trivially
+// copyable.
+template <typename Node>
+class Mapped_Storage
+{
+    struct Header {
+        uint32_t _magic;
+        uint32_t _version;
+        uint32_t _node_size;
+        uint32_t _dirty;
+        uint32_t _root;
+        uint32_t _free;
+        uint32_t _size;
+        uint32_t _count;
+    };
+
+    // "AVLM" as read on a little-endian host.
+    static const uint32_t FILE_MAGIC = 0x4d4c5641;
+    static const uint32_t FILE_VERSION = 1;
+    // Compact_AVL_Tree's null index.
+    static const uint32_t NIL = 0x7FFFFFFF;
+    // Nodes start one cache line into the file.
+    static const std::size_t NODES_OFFSET = 64;
+    static const std::size_t FIRST_CAPACITY = 1024;
+
+    int _fd;
+    bool _writable;
+    bool _dirty;
+    char * _base;
+    std::size_t _capacity;
+    std::size_t _count;
+
+    Header * __header() const;
+    Node * __nodes() const;
+    bool __map(std::size_t capacity);
+    void __unmap();
+    bool __sync(std::size_t length);
+
+public:
+    explicit Mapped_Storage(const char * path, bool read_only = false);
+    ~Mapped_Storage();
+
+    Mapped_Storage(const Mapped_Storage &) = delete;
+    Mapped_Storage & operator=(const Mapped_Storage &) = delete;
+
+    bool is_open() const;
+    bool modify();
+    bool restore(uint32_t & root, uint32_t & free, unsigned & size) const;
+    bool flush(uint32_t root, uint32_t free, unsigned size);
+
+    std::size_t size() const;
+    std::size_t capacity() const;
+    void reserve(std::size_t count);
+    void push_back(const Node & node);
+    void clear();
+    Node & operator[](std::size_t index);
+    const Node & operator[](std::size_t index) const;
+};
+
+// Opens or creates the file at path. A file that is not a node file of
+// this Node type, was left dirty, or whose header points past its nodes
+// is not touched: is_open() is false and the tree sees no nodes.
+template <typename Node>
+Mapped_Storage<Node>::Mapped_Storage(const char *path, bool read_only):
+    _fd(-1), _writable(false), _dirty(false), _base(NULL), _capacity(0), _count(0)
+{
+    static_assert(std::is_trivially_copyable<Node>::value, "Mapped_Storage needs a trivially copyable T");
+    static_assert(sizeof(Header) <= NODES_OFFSET && NODES_OFFSET % alignof(Node) == 0, "header overlaps the nodes");
+    _fd = ::open(path, read_only ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+    if(_fd < 0)
+        return;
+    struct stat status;
+    if(fstat(_fd, &status) != 0)
+    {
+        __unmap();
+        return;
+    }
+    std::size_t length = std::size_t(status.st_size);
+    if(length == 0 && !read_only)
+    {
+        if(!__map(FIRST_CAPACITY))
+            return;
+        Header & header = *__header();
+        header._magic = FILE_MAGIC;
+        header._version = FILE_VERSION;
+        header._node_size = sizeof(Node);
+        header._dirty = 0;
+        header._root = header._free = NIL;
+        header._size = header._count = 0;
+        _writable = true;
+        return;
+    }
+    if(length < NODES_OFFSET)
+    {
+        __unmap();
+        return;
+    }
+    void * base = mmap(NULL, length, read_only ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if(base == MAP_FAILED)
+    {
+        __unmap();
+        return;
+    }
+    _base = static_cast<char *>(base);
+    _capacity = (length - NODES_OFFSET) / sizeof(Node);
+    const Header & header = *__header();
+    if(header._magic != FILE_MAGIC || header._version != FILE_VERSION || header._node_size != sizeof(Node) ||
+       header._dirty != 0 || header._count > _capacity || header._size > header._count ||
+       (header._root != NIL && header._root >= header._count) || (header._free != NIL && header._free >= header._count))
+    {
+        __unmap();
+        return;
+    }
+    _count = header._count;
+    _writable = !read_only;
+}
+
+// Unmapping writes nothing back to the header, so changes made since the
+// last flush leave the file dirty; Compact_AVL_Tree flushes first.
+template <typename Node>
+Mapped_Storage<Node>::~Mapped_Storage()
+{
+    __unmap();
+}
+
+template <typename Node>
+bool Mapped_Storage<Node>::is_open() const
+{
+    return _base != NULL;
+}
+
+// Called before every change. Marks the file dirty on disk before the
+// first change after a flush, so that no node page can be written back
+// ahead of that mark.
+template <typename Node>
+bool Mapped_Storage<Node>::modify()
+{
+    if(!_writable)
+        return false;
+    if(!_dirty)
+    {
+        __header()->_dirty = 1;
+        if(!__sync(NODES_OFFSET))
+            return false;
+        _dirty = true;
+    }
+    return true;
+}
+
+template <typename Node>
+bool Mapped_Storage<Node>::restore(uint32_t &root, uint32_t &free, unsigned &size) const
+{
+    if(_base == NULL)
+        return false;
+    const Header & header = *__header();
+    root = header._root;
+    free = header._free;
+    size = header._size;
+    return true;
+}
+
+// Writes the tree's state into the header and every changed page to disk,
+// then clears the dirty mark.
+template <typename Node>
+bool Mapped_Storage<Node>::flush(uint32_t root, uint32_t free, unsigned size)
+{
+    if(!_writable)
+        return _base != NULL;
+    if(!_dirty)
+        return true;
+    Header & header = *__header();
+    header._root = root;
+    header._free = free;
+    header._size = size;
+    header._count = uint32_t(_count);
+    if(!__sync(NODES_OFFSET + _capacity * sizeof(Node)))
+        return false;
+    header._dirty = 0;
+    if(!__sync(NODES_OFFSET))
+        return false;
+    _dirty = false;
+    return true;
+}
+
+template <typename Node>
+std::size_t Mapped_Storage<Node>::size() const
+{
+    return _count;
+}
+
+template <typename Node>
+std::size_t Mapped_Storage<Node>::capacity() const
+{
+    return _capacity;
+}
+
+template <typename Node>
+void Mapped_Storage<Node>::reserve(std::size_t count)
+{
+    if(_writable && count > _capacity)
+        __map(count);
+}
+
+// The file grows by doubling, so appending stays amortized O(1); growing
+// remaps it, which moves every node. Like vector, throws bad_alloc when
+// it cannot grow.
+template <typename Node>
+void Mapped_Storage<Node>::push_back(const Node &node)
+{
+    if(_count == _capacity && !__map(_capacity < FIRST_CAPACITY ? FIRST_CAPACITY : _capacity * 2))
+        throw std::bad_alloc();
+    __nodes()[_count++] = node;
+}
+
+template <typename Node>
+void Mapped_Storage<Node>::clear()
+{
+    _count = 0;
+}
+
+template <typename Node>
+Node &Mapped_Storage<Node>::operator[](std::size_t index)
+{
+    return __nodes()[index];
+}
+
+template <typename Node>
+const Node &Mapped_Storage<Node>::operator[](std::size_t index) const
+{
+    return __nodes()[index];
+}
+
+template <typename Node>
+typename Mapped_Storage<Node>::Header *Mapped_Storage<Node>::__header() const
+{
+    return reinterpret_cast<Header *>(_base);
+}
+
+template <typename Node>
+Node *Mapped_Storage<Node>::__nodes() const
+{
+    return reinterpret_cast<Node *>(_base + NODES_OFFSET);
+}
+
+// Sizes the file for capacity nodes and maps all of it.
+template <typename Node>
+bool Mapped_Storage<Node>::__map(std::size_t capacity)
+{
+    std::size_t length = NODES_OFFSET + capacity * sizeof(Node);
+    if(ftruncate(_fd, off_t(length)) != 0)
+        return false;
+    void * base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if(base == MAP_FAILED)
+        return false;
+    if(_base != NULL)
+        munmap(_base, NODES_OFFSET + _capacity * sizeof(Node));
+    _base = static_cast<char *>(base);
+    _capacity = capacity;
+    return true;
+}
+
+template <typename Node>
+void Mapped_Storage<Node>::__unmap()
+{
+    if(_base != NULL)
+        munmap(_base, NODES_OFFSET + _capacity * sizeof(Node));
+    if(_fd >= 0)
+        ::close(_fd);
+    _base = NULL;
+    _fd = -1;
+    _writable = false;
+    _capacity = 0;
+    _count = 0;
+}
+
+template <typename Node>
+bool Mapped_Storage<Node>::__sync(std::size_t length)
+{
+    return msync(_base, length, MS_SYNC) == 0;
+}
+
+#endif // MAPPED_STORAGE_H
@@ -0,0 +1,219 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <cstddef>
+
+#include <memory>
+using std::allocator;
+using std::allocator_traits;
+using std::shared_ptr;
+
+#include <mutex>
+using std::mutex;
+using std::unique_lock;
+
+#include <utility>
+using std::pair;
+using std::make_pair;
+
+#include <vector>
+using std::vector;
+
+// Slab allocator for tree nodes. Storage is carved out of contiguous blocks
+// obtained from Allocator; freed nodes are threaded into a free list and
+// handed out again before a block is touched. The pool only deals with raw
+// storage: constructing and destroying the node is up to the caller.
+//
+// Pools held through shared_ptr can be merged: absorb() takes over another
+// pool's blocks, and leaves it forwarding to the pool that took them.
+//
+// A pool serves one thread unless share() was called, as it is once two
+// trees allocate from it; from then on allocate() and deallocate() take a
+// lock, until unshare() is called by the last owner.
+template <typename Node, typename Allocator = allocator<Node> >
+class Node_Pool
+{
+    typedef typename allocator_traits<Allocator>::template rebind_alloc<Node> Node_Allocator;
+    typedef allocator_traits<Node_Allocator> Node_Allocator_Traits;
+
+    struct Free_Slot {
+        Free_Slot * _next;
+    };
+
+    static const std::size_t FIRST_BLOCK_SIZE = 32;
+    static const std::size_t MAX_BLOCK_SIZE = 4096;
+
+    Node_Allocator _allocator;
+    vector<pair<Node *, std::size_t> > _blocks;
+    Free_Slot * _free;
+    Free_Slot * _free_tail;
+    Node * _next;
+    Node * _end;
+    std::size_t _capacity;
+    shared_ptr<Node_Pool> _forward;
+    mutex _mutex;
+    bool _shared;
+
+    void __grow();
+
+public:
+    explicit Node_Pool(const Allocator & allocator = Allocator());
+    ~Node_Pool();
+
+    Node_Pool(const Node_Pool &) = delete;
+    Node_Pool & operator=(const Node_Pool &) = delete;
+
+    Node * allocate();
+    void deallocate(Node * node);
+    void release();
+    void absorb(Node_Pool & other, const shared_ptr<Node_Pool> & self);
+    void share();
+    void unshare();
+
+    const shared_ptr<Node_Pool> & forward() const;
+    std::size_t capacity() const;
+    std::size_t memory_usage() const;
+};
+
+template <typename Node, typename Allocator>
+Node_Pool<Node, Allocator>::Node_Pool(const Allocator &allocator):
+    _allocator(allocator), _free(NULL), _free_tail(NULL), _next(NULL), _end(NULL), _capacity(0), _shared(false)
+{
+    static_assert(sizeof(Node) >= sizeof(Free_Slot), "Node too small to be pooled");
+}
+
+template <typename Node, typename Allocator>
+Node_Pool<Node, Allocator>::~Node_Pool()
+{
+    release();
+}
+
+template <typename Node, typename Allocator>
+Node *Node_Pool<Node, Allocator>::allocate()
+{
+    unique_lock<mutex> lock(_mutex, std::defer_lock);
+    if(_shared)
+        lock.lock();
+    if(_free != NULL)
+    {
+        Free_Slot * slot = _free;
+        _free = slot->_next;
+        if(_free == NULL)
+            _free_tail = NULL;
+        return reinterpret_cast<Node *>(slot);
+    }
+    if(_next == _end)
+        __grow();
+    return _next++;
+}
+
+template <typename Node, typename Allocator>
+void Node_Pool<Node, Allocator>::deallocate(Node *node)
+{
+    unique_lock<mutex> lock(_mutex, std::defer_lock);
+    if(_shared)
+        lock.lock();
+    Free_Slot * slot = reinterpret_cast<Free_Slot *>(node);
+    slot->_next = _free;
+    if(_free == NULL)
+        _free_tail = slot;
+    _free = slot;
+}
+
+// Gives every block back to the allocator at once. Nodes still living in
+// the pool are not destroyed.
+template <typename Node, typename Allocator>
+void Node_Pool<Node, Allocator>::release()
+{
+    for(std::size_t i = 0; i < _blocks.size(); i++)
+        Node_Allocator_Traits::deallocate(_allocator, _blocks[i].first, _blocks[i].second);
+    _blocks.clear();
+    _free = _free_tail = NULL;
+    _next = _end = NULL;
+    _capacity = 0;
+}
+
+// Takes over the blocks and free slots of other, whose nodes may then be
+// deallocated here, and makes other forward to self, the shared_ptr
+// holding this pool. The unused tail of other's current block is dropped
+// until release(). Both pools must use allocators that compare equal, and
+// no other thread may be following other's forward link meanwhile.
+template <typename Node, typename Allocator>
+void Node_Pool<Node, Allocator>::absorb(Node_Pool &other, const shared_ptr<Node_Pool> &self)
+{
+    unique_lock<mutex> lock(_mutex, std::defer_lock);
+    unique_lock<mutex> other_lock(other._mutex, std::defer_lock);
+    if(_shared || other._shared)
+        std::lock(lock, other_lock);
+    _shared = _shared || other._shared;
+    _blocks.insert(_blocks.end(), other._blocks.begin(), other._blocks.end());
+    _capacity += other._capacity;
+    if(other._free != NULL)
+    {
+        if(_free == NULL)
+            _free_tail = other._free_tail;
+        else
+            other._free_tail->_next = _free;
+        _free = other._free;
+    }
+    other._blocks.clear();
+    other._free = other._free_tail = NULL;
+    other._next = other._end = NULL;
+    other._capacity = 0;
+    other._forward = self;
+}
+
+// Called while only one thread uses the pool, before it is handed to
+// another.
+template <typename Node, typename Allocator>
+void Node_Pool<Node, Allocator>::share()
+{
+    _shared = true;
+}
+
+// Called by the only remaining owner. Taking the lock once orders its
+// later unlocked accesses after those of the owners that went away.
+template <typename Node, typename Allocator>
+void Node_Pool<Node, Allocator>::unshare()
+{
+    if(!_shared)
+        return;
+    unique_lock<mutex> lock(_mutex);
+    _shared = false;
+}
+
+// The pool that absorbed this one, if any.
+template <typename Node, typename Allocator>
+const shared_ptr<Node_Pool<Node, Allocator> > &Node_Pool<Node, Allocator>::forward() const
+{
+    return _forward;
+}
+
+template <typename Node, typename Allocator>
+std::size_t Node_Pool<Node, Allocator>::capacity() const
+{
+    return _capacity;
+}
+
+template <typename Node, typename Allocator>
+std::size_t Node_Pool<Node, Allocator>::memory_usage() const
+{
+    return _capacity * sizeof(Node) + _blocks.capacity() * sizeof(pair<Node *, std::size_t>);
+}
+
+template <typename Node, typename Allocator>
+void Node_Pool<Node, Allocator>::__grow()
+{
+    std::size_t block_size = FIRST_BLOCK_SIZE;
+    if(!_blocks.empty())
+        block_size = _blocks.back().second * 2;
+    if(block_size > MAX_BLOCK_SIZE)
+        block_size = MAX_BLOCK_SIZE;
+    Node * block = Node_Allocator_Traits::allocate(_allocator, block_size);
+    _blocks.push_back(make_pair(block, block_size));
+    _next = block;
+    _end = block + block_size;
+    _capacity += block_size;
+}
+
+#endif // NODE_POOL_H
@@ -0,0 +1,83 @@
+#ifndef RANGE_LOOKUP_H
+#define RANGE_LOOKUP_H
+
+#include <cstddef>
+
+#include <algorithm>
+
+#include <vector>
+using std::vector;
+
+// Point queries on a tree of disjoint ranges ordered by address, such as
+// AVL_Tree<NonOverlappingInterval>; the elements expose begin() and end().
+// They go through the tree's find_by() and lower_bound_by(), comparing the
+// address with the bounds directly instead of building a one-unit range.
+//
+//   AVL_Tree<NonOverlappingInterval>::const_iterator found = find_containing(tree, address);
+
+// Where address sorts against a range: before it, inside it, or after it.
+struct Address_Compare {
+    int _address;
+
+    explicit Address_Compare(int address): _address(address) {}
+    template <typename T>
+    int operator()(const T & value) const
+    {
+        if(_address < value.begin())
+            return -1;
+        return _address > value.end() ? 1 : 0;
+    }
+};
+
+// The element containing address, or end().
+template <typename Tree>
+typename Tree::const_iterator find_containing(const Tree & tree, int address)
+{
+    return tree.find_by(Address_Compare(address));
+}
+
+// find_containing() for every address of [first, last), written to found
+// in the same order. The addresses are answered in ascending order, sorted
+// first unless they already are, by one sweep that steps the iterator
+// forward from the previous answer. A gap of more than about log n
+// elements is crossed by a fresh descent instead, so m addresses cost
+// O(min(n + m, m log n)) after sorting.
+template <typename Tree, typename Random_Access_Iterator, typename Output_Iterator>
+void find_containing_batch(const Tree & tree, Random_Access_Iterator first, Random_Access_Iterator last, Output_Iterator found)
+{
+    typedef typename Tree::const_iterator const_iterator;
+    std::size_t count = last - first;
+    vector<std::size_t> order(count);
+    bool sorted = true;
+    for(std::size_t i = 0; i < count; i++)
+    {
+        order[i] = i;
+        if(i > 0 && first[i] < first[i - 1])
+            sorted = false;
+    }
+    if(!sorted)
+        std::stable_sort(order.begin(), order.end(), [&first](std::size_t a, std::size_t b) { return first[a] < first[b]; });
+    unsigned limit = 1;
+    for(unsigned n = tree.size(); n != 0; n >>= 1)
+        limit++;
+    vector<const_iterator> results(count, tree.end());
+    const_iterator position = tree.end();
+    for(std::size_t i = 0; i < count; i++)
+    {
+        int address = first[order[i]];
+        unsigned steps = 0;
+        if(i > 0)
+            while(position != tree.end() && position->end() < address && steps++ < limit)
+                ++position;
+        if(i == 0 || (position != tree.end() && position->end() < address))
+            position = tree.lower_bound_by(Address_Compare(address));
+        if(position == tree.end())
+            break;
+        if(position->begin() <= address)
+            results[order[i]] = position;
+    }
+    for(std::size_t i = 0; i < count; i++)
+        *found++ = results[i];
+}
+
+#endif // RANGE_LOOKUP_H
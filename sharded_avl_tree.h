@@ -0,0 +1,223 @@
+#ifndef SHARDED_AVL_TREE_H
+#define SHARDED_AVL_TREE_H
+
+#include <atomic>
+using std::atomic;
+
+#include <mutex>
+using std::mutex;
+
+#include <vector>
+using std::vector;
+
+#include "avl_tree.h"
+
+// AVL tree of disjoint ranges split by address into shards, each one an
+// AVL_Tree behind its own mutex, so writers working on different regions
+// do not wait for each other. T must expose begin() and end(). A range is
+// stored in every shard it touches; operations lock the shards they span
+// in ascending order, which keeps them deadlock free.
+template <typename T>
+class Sharded_AVL_Tree
+{
+    struct Shard {
+        mutex _mutex;
+        AVL_Tree<T> _tree;
+    };
+
+    long long _first;
+    long long _width;
+    vector<Shard> _shards;
+    atomic<unsigned> _size;
+
+    unsigned __shard(long long address) const;
+    void __lock(unsigned first, unsigned last);
+    void __unlock(unsigned first, unsigned last);
+    const T * __find(unsigned first, unsigned last, const T & value);
+
+public:
+    Sharded_AVL_Tree(int first, int last, unsigned shards);
+
+    Sharded_AVL_Tree(const Sharded_AVL_Tree &) = delete;
+    Sharded_AVL_Tree & operator=(const Sharded_AVL_Tree &) = delete;
+
+    bool empty();
+    bool insert(const T & value);
+    void clear();
+    bool check(const T & value);
+
+    unsigned size();
+    unsigned shards();
+
+    bool find(const T & value, T & found);
+    bool remove(const T & value);
+    bool extract(const T & value, T & removed);
+};
+
+// Splits [first, last] into shards slices of equal width. Addresses outside
+// it belong to the first or the last shard.
+template <typename T>
+Sharded_AVL_Tree<T>::Sharded_AVL_Tree(int first, int last, unsigned shards):
+    _first(first), _shards(shards == 0 ? 1 : shards), _size(0)
+{
+    long long count = _shards.size();
+    _width = ((long long)last - first + count) / count;
+    if(_width < 1)
+        _width = 1;
+}
+
+template <typename T>
+bool Sharded_AVL_Tree<T>::empty()
+{
+    return _size.load() == 0;
+}
+
+template <typename T>
+bool Sharded_AVL_Tree<T>::insert(const T &value)
+{
+    unsigned first = __shard(value.begin());
+    unsigned last = __shard(value.end());
+    __lock(first, last);
+    bool free = true;
+    for(unsigned i = first; free && i <= last; i++)
+        free = !_shards[i]._tree.check(value);
+    if(free)
+    {
+        for(unsigned i = first; i <= last; i++)
+            _shards[i]._tree.insert(value);
+        _size++;
+    }
+    __unlock(first, last);
+    return free;
+}
+
+template <typename T>
+void Sharded_AVL_Tree<T>::clear()
+{
+    __lock(0, _shards.size() - 1);
+    for(unsigned i = 0; i < _shards.size(); i++)
+        _shards[i]._tree.clear();
+    _size.store(0);
+    __unlock(0, _shards.size() - 1);
+}
+
+template <typename T>
+bool Sharded_AVL_Tree<T>::check(const T &value)
+{
+    unsigned first = __shard(value.begin());
+    unsigned last = __shard(value.end());
+    __lock(first, last);
+    bool found = __find(first, last, value) != NULL;
+    __unlock(first, last);
+    return found;
+}
+
+template <typename T>
+unsigned Sharded_AVL_Tree<T>::size()
+{
+    return _size.load();
+}
+
+template <typename T>
+unsigned Sharded_AVL_Tree<T>::shards()
+{
+    return _shards.size();
+}
+
+// Copies the stored range overlapping value into found, since it may be
+// removed as soon as the locks are dropped.
+template <typename T>
+bool Sharded_AVL_Tree<T>::find(const T &value, T &found)
+{
+    unsigned first = __shard(value.begin());
+    unsigned last = __shard(value.end());
+    __lock(first, last);
+    const T * stored = __find(first, last, value);
+    if(stored != NULL)
+        found = *stored;
+    __unlock(first, last);
+    return stored != NULL;
+}
+
+template <typename T>
+bool Sharded_AVL_Tree<T>::remove(const T &value)
+{
+    T removed = value;
+    return extract(value, removed);
+}
+
+// The stored range may reach past the shards value spans, in which case
+// the locks are dropped and taken again over the wider span.
+template <typename T>
+bool Sharded_AVL_Tree<T>::extract(const T &value, T &removed)
+{
+    unsigned first = __shard(value.begin());
+    unsigned last = __shard(value.end());
+    while(true)
+    {
+        __lock(first, last);
+        const T * found = __find(first, last, value);
+        if(found == NULL)
+        {
+            __unlock(first, last);
+            return false;
+        }
+        unsigned found_first = __shard(found->begin());
+        unsigned found_last = __shard(found->end());
+        if(found_first >= first && found_last <= last)
+        {
+            removed = *found;
+            for(unsigned i = found_first; i <= found_last; i++)
+                _shards[i]._tree.remove(removed);
+            _size--;
+            __unlock(first, last);
+            return true;
+        }
+        __unlock(first, last);
+        if(found_first < first)
+            first = found_first;
+        if(found_last > last)
+            last = found_last;
+    }
+}
+
+template <typename T>
+unsigned Sharded_AVL_Tree<T>::__shard(long long address) const
+{
+    if(address < _first)
+        return 0;
+    long long shard = (address - _first) / _width;
+    if(shard >= (long long)_shards.size())
+        return _shards.size() - 1;
+    return unsigned(shard);
+}
+
+template <typename T>
+void Sharded_AVL_Tree<T>::__lock(unsigned first, unsigned last)
+{
+    for(unsigned i = first; i <= last; i++)
+        _shards[i]._mutex.lock();
+}
+
+template <typename T>
+void Sharded_AVL_Tree<T>::__unlock(unsigned first, unsigned last)
+{
+    for(unsigned i = last + 1; i-- > first; )
+        _shards[i]._mutex.unlock();
+}
+
+// A stored range overlapping value shares an address with it, and is
+// stored in the shard of that address.
+template <typename T>
+const T *Sharded_AVL_Tree<T>::__find(unsigned first, unsigned last, const T &value)
+{
+    for(unsigned i = first; i <= last; i++)
+    {
+        typename AVL_Tree<T>::const_iterator found = _shards[i]._tree.find(value);
+        if(found != _shards[i]._tree.end())
+            return &*found;
+    }
+    return NULL;
+}
+
+#endif // SHARDED_AVL_TREE_H
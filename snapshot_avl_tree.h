@@ -0,0 +1,479 @@
+#ifndef SNAPSHOT_AVL_TREE_H
+#define SNAPSHOT_AVL_TREE_H
+
+#include <cstddef>
+#include <new>
+
+#include <algorithm>
+using std::max;
+
+#include <atomic>
+using std::atomic;
+
+#include <mutex>
+using std::mutex;
+using std::lock_guard;
+
+#include <thread>
+
+#include <utility>
+using std::pair;
+using std::make_pair;
+
+#include <vector>
+using std::vector;
+
+#include "node_pool.h"
+
+// AVL tree for many lock-free readers and one writer at a time. Nodes are
+// never modified once published: insert and remove copy the path they
+// change and publish the new root atomically, so a reader holding a
+// Snapshot keeps seeing the version it started with. Replaced nodes are
+// reclaimed once no snapshot taken before their replacement is alive,
+// which readers announce by pinning the current epoch in a slot.
+//
+// All snapshots must be gone before the tree is destroyed.
+template <typename T>
+class Snapshot_AVL_Tree
+{
+    class Node {
+    public:
+        const Node * _left;
+        const Node * _right;
+        T _value;
+        unsigned _height;
+
+        Node(const T & value, const Node * left, const Node * right);
+    };
+
+    static const int MAX_READERS = 128;
+    static const std::size_t RECLAIM_THRESHOLD = 64;
+
+    atomic<const Node *> _root;
+    atomic<unsigned> _size;
+    mutable atomic<unsigned long> _epoch;
+    mutable atomic<unsigned long> _readers[MAX_READERS];
+
+    mutex _writer;
+    Node_Pool<Node> _pool;
+    vector<const Node *> _replaced;
+    vector<pair<unsigned long, const Node *> > _retired;
+
+    const Node * __make(const T & value, const Node * left, const Node * right);
+    const Node * __balance(const T & value, const Node * left, const Node * right);
+    const Node * __insert(const Node * root, const T & value, bool & inserted);
+    const Node * __remove(const Node * root, const T & value, const Node *& removed);
+    const Node * __remove_min(const Node * root, const Node *& min);
+    void __replace(const Node * node);
+    void __publish(const Node * root);
+    void __reclaim();
+    void __destroy(const Node * node);
+    void __destroy_subtree(const Node * root);
+    int __pin() const;
+
+    static unsigned __height(const Node * node);
+    static const Node * __find(const Node * root, const T & value);
+    template <typename Function>
+    static void __for_each_in_range(const Node * root, const T & low, const T & high, Function & f);
+
+public:
+    // A consistent, read-only view of the tree. Taking one and reading
+    // through it never blocks.
+    class Snapshot {
+        friend class Snapshot_AVL_Tree;
+        const Snapshot_AVL_Tree * _tree;
+        int _slot;
+        const Node * _root;
+        Snapshot(const Snapshot_AVL_Tree * tree, int slot);
+    public:
+        Snapshot(Snapshot && o);
+        ~Snapshot();
+
+        Snapshot(const Snapshot &) = delete;
+        Snapshot & operator=(const Snapshot &) = delete;
+
+        bool empty() const;
+        const T * root() const;
+        const T * find(const T & value) const;
+        template <typename Function>
+        void for_each_in_range(const T & low, const T & high, Function f) const;
+    };
+
+    Snapshot_AVL_Tree();
+    virtual ~Snapshot_AVL_Tree();
+
+    Snapshot_AVL_Tree(const Snapshot_AVL_Tree &) = delete;
+    Snapshot_AVL_Tree & operator=(const Snapshot_AVL_Tree &) = delete;
+
+    bool empty() const;
+    bool insert(const T & value);
+    unsigned size() const;
+
+    Snapshot snapshot() const;
+    bool find(const T & value, T & found) const;
+    bool remove(const T & value);
+    bool extract(const T & value, T & removed);
+};
+
+// TREE
+template <typename T>
+Snapshot_AVL_Tree<T>::Snapshot_AVL_Tree(): _root(NULL), _size(0), _epoch(1)
+{
+    for(int i = 0; i < MAX_READERS; i++)
+        _readers[i].store(0);
+}
+
+template <typename T>
+Snapshot_AVL_Tree<T>::~Snapshot_AVL_Tree()
+{
+    for(std::size_t i = 0; i < _retired.size(); i++)
+        __destroy(_retired[i].second);
+    __destroy_subtree(_root.load());
+    _pool.release();
+}
+
+template <typename T>
+bool Snapshot_AVL_Tree<T>::empty() const
+{
+    return _size.load() == 0;
+}
+
+template <typename T>
+bool Snapshot_AVL_Tree<T>::insert(const T &value)
+{
+    lock_guard<mutex> lock(_writer);
+    bool inserted = false;
+    const Node * root = __insert(_root.load(), value, inserted);
+    if(!inserted)
+        return false;
+    _size++;
+    __publish(root);
+    return true;
+}
+
+template <typename T>
+unsigned Snapshot_AVL_Tree<T>::size() const
+{
+    return _size.load();
+}
+
+template <typename T>
+typename Snapshot_AVL_Tree<T>::Snapshot Snapshot_AVL_Tree<T>::snapshot() const
+{
+    return Snapshot(this, __pin());
+}
+
+// Copies the element out, since it may be reclaimed once the snapshot
+// taken to read it is gone.
+template <typename T>
+bool Snapshot_AVL_Tree<T>::find(const T &value, T &found) const
+{
+    Snapshot view = snapshot();
+    const T * stored = view.find(value);
+    if(stored == NULL)
+        return false;
+    found = *stored;
+    return true;
+}
+
+template <typename T>
+bool Snapshot_AVL_Tree<T>::remove(const T &value)
+{
+    T removed = value;
+    return extract(value, removed);
+}
+
+// Readers may still hold the removed node, so its element is copied out
+// rather than moved.
+template <typename T>
+bool Snapshot_AVL_Tree<T>::extract(const T &value, T &removed)
+{
+    lock_guard<mutex> lock(_writer);
+    const Node * node = NULL;
+    const Node * root = __remove(_root.load(), value, node);
+    if(node == NULL)
+        return false;
+    removed = node->_value; // node may be reclaimed on publish
+    _size--;
+    __publish(root);
+    return true;
+}
+
+template <typename T>
+const typename Snapshot_AVL_Tree<T>::Node *Snapshot_AVL_Tree<T>::__make(const T &value, const Node *left, const Node *right)
+{
+    return new (_pool.allocate()) Node(value, left, right);
+}
+
+// New node for value over left and right, rotating with fresh copies when
+// their heights differ by two. Nodes the rotation takes apart are replaced.
+template <typename T>
+const typename Snapshot_AVL_Tree<T>::Node *Snapshot_AVL_Tree<T>::__balance(const T &value, const Node *left, const Node *right)
+{
+    if(__height(left) > __height(right) + 1)
+    {
+        __replace(left);
+        if(__height(left->_left) >= __height(left->_right))
+            return __make(left->_value, left->_left, __make(value, left->_right, right));
+        const Node * inner = left->_right;
+        __replace(inner);
+        return __make(inner->_value, __make(left->_value, left->_left, inner->_left), __make(value, inner->_right, right));
+    }
+    if(__height(right) > __height(left) + 1)
+    {
+        __replace(right);
+        if(__height(right->_right) >= __height(right->_left))
+            return __make(right->_value, __make(value, left, right->_left), right->_right);
+        const Node * inner = right->_left;
+        __replace(inner);
+        return __make(inner->_value, __make(value, left, inner->_left), __make(right->_value, inner->_right, right->_right));
+    }
+    return __make(value, left, right);
+}
+
+template <typename T>
+const typename Snapshot_AVL_Tree<T>::Node *Snapshot_AVL_Tree<T>::__insert(const Node *root, const T &value, bool &inserted)
+{
+    if(root == NULL)
+    {
+        inserted = true;
+        return __make(value, NULL, NULL);
+    }
+    if(value < root->_value)
+    {
+        const Node * left = __insert(root->_left, value, inserted);
+        if(!inserted)
+            return root;
+        __replace(root);
+        return __balance(root->_value, left, root->_right);
+    }
+    if(value > root->_value)
+    {
+        const Node * right = __insert(root->_right, value, inserted);
+        if(!inserted)
+            return root;
+        __replace(root);
+        return __balance(root->_value, root->_left, right);
+    }
+    return root;
+}
+
+template <typename T>
+const typename Snapshot_AVL_Tree<T>::Node *Snapshot_AVL_Tree<T>::__remove(const Node *root, const T &value, const Node *&removed)
+{
+    if(root == NULL)
+        return NULL;
+    if(value < root->_value)
+    {
+        const Node * left = __remove(root->_left, value, removed);
+        if(removed == NULL)
+            return root;
+        __replace(root);
+        return __balance(root->_value, left, root->_right);
+    }
+    if(value > root->_value)
+    {
+        const Node * right = __remove(root->_right, value, removed);
+        if(removed == NULL)
+            return root;
+        __replace(root);
+        return __balance(root->_value, root->_left, right);
+    }
+    removed = root;
+    __replace(root);
+    if(root->_left == NULL)
+        return root->_right;
+    if(root->_right == NULL)
+        return root->_left;
+    const Node * successor;
+    const Node * right = __remove_min(root->_right, successor);
+    return __balance(successor->_value, root->_left, right);
+}
+
+template <typename T>
+const typename Snapshot_AVL_Tree<T>::Node *Snapshot_AVL_Tree<T>::__remove_min(const Node *root, const Node *&min)
+{
+    __replace(root);
+    if(root->_left == NULL)
+    {
+        min = root;
+        return root->_right;
+    }
+    const Node * left = __remove_min(root->_left, min);
+    return __balance(root->_value, left, root->_right);
+}
+
+template <typename T>
+void Snapshot_AVL_Tree<T>::__replace(const Node *node)
+{
+    _replaced.push_back(node);
+}
+
+// Makes root the current version. Nodes replaced while building it are
+// stamped with the epoch that was current at that moment: readers that
+// pinned a later epoch can only have loaded the new root.
+template <typename T>
+void Snapshot_AVL_Tree<T>::__publish(const Node *root)
+{
+    _root.store(root);
+    unsigned long epoch = _epoch.fetch_add(1);
+    for(std::size_t i = 0; i < _replaced.size(); i++)
+        _retired.push_back(make_pair(epoch, _replaced[i]));
+    _replaced.clear();
+    if(_retired.size() >= RECLAIM_THRESHOLD)
+        __reclaim();
+}
+
+template <typename T>
+void Snapshot_AVL_Tree<T>::__reclaim()
+{
+    unsigned long oldest = _epoch.load();
+    for(int i = 0; i < MAX_READERS; i++)
+    {
+        unsigned long pinned = _readers[i].load();
+        if(pinned != 0 && pinned < oldest)
+            oldest = pinned;
+    }
+    std::size_t kept = 0;
+    for(std::size_t i = 0; i < _retired.size(); i++)
+    {
+        if(_retired[i].first < oldest)
+            __destroy(_retired[i].second);
+        else
+            _retired[kept++] = _retired[i];
+    }
+    _retired.resize(kept);
+}
+
+template <typename T>
+void Snapshot_AVL_Tree<T>::__destroy(const Node *node)
+{
+    Node * mutable_node = const_cast<Node *>(node);
+    mutable_node->~Node();
+    _pool.deallocate(mutable_node);
+}
+
+template <typename T>
+void Snapshot_AVL_Tree<T>::__destroy_subtree(const Node *root)
+{
+    if(root == NULL)
+        return;
+    __destroy_subtree(root->_left);
+    __destroy_subtree(root->_right);
+    __destroy(root);
+}
+
+// Claims a free reader slot and stores the current epoch in it.
+template <typename T>
+int Snapshot_AVL_Tree<T>::__pin() const
+{
+    while(true)
+    {
+        for(int i = 0; i < MAX_READERS; i++)
+        {
+            unsigned long expected = 0;
+            if(_readers[i].load() == 0 && _readers[i].compare_exchange_strong(expected, _epoch.load()))
+                return i;
+        }
+        std::this_thread::yield();
+    }
+}
+
+template <typename T>
+unsigned Snapshot_AVL_Tree<T>::__height(const Node *node)
+{
+    return node == NULL ? 0 : node->_height;
+}
+
+template <typename T>
+const typename Snapshot_AVL_Tree<T>::Node *Snapshot_AVL_Tree<T>::__find(const Node *root, const T &value)
+{
+    while(root != NULL)
+    {
+        if(value < root->_value)
+            root = root->_left;
+        else if(value > root->_value)
+            root = root->_right;
+        else
+            return root;
+    }
+    return NULL;
+}
+
+template <typename T>
+template <typename Function>
+void Snapshot_AVL_Tree<T>::__for_each_in_range(const Node *root, const T &low, const T &high, Function &f)
+{
+    if(root == NULL)
+        return;
+    bool after_low = !(root->_value < low);
+    bool before_high = !(high < root->_value);
+    if(after_low)
+        __for_each_in_range(root->_left, low, high, f);
+    if(after_low && before_high)
+        f(root->_value);
+    if(before_high)
+        __for_each_in_range(root->_right, low, high, f);
+}
+
+
+// SNAPSHOT
+template <typename T>
+Snapshot_AVL_Tree<T>::Snapshot::Snapshot(const Snapshot_AVL_Tree *tree, int slot):
+    _tree(tree), _slot(slot), _root(tree->_root.load()) {}
+
+template <typename T>
+Snapshot_AVL_Tree<T>::Snapshot::Snapshot(Snapshot &&o): _tree(o._tree), _slot(o._slot), _root(o._root)
+{
+    o._tree = NULL;
+}
+
+template <typename T>
+Snapshot_AVL_Tree<T>::Snapshot::~Snapshot()
+{
+    if(_tree != NULL)
+        _tree->_readers[_slot].store(0);
+}
+
+template <typename T>
+bool Snapshot_AVL_Tree<T>::Snapshot::empty() const
+{
+    return _root == NULL;
+}
+
+// The pointers returned by root() and find() stay valid for as long as the
+// snapshot does.
+template <typename T>
+const T *Snapshot_AVL_Tree<T>::Snapshot::root() const
+{
+    if(_root == NULL)
+        return NULL;
+    return &_root->_value;
+}
+
+template <typename T>
+const T *Snapshot_AVL_Tree<T>::Snapshot::find(const T &value) const
+{
+    const Node * node = __find(_root, value);
+    if(node == NULL)
+        return NULL;
+    return &node->_value;
+}
+
+// Visits, in order, every element between low and high, bounds included,
+// in O(log n + k).
+template <typename T>
+template <typename Function>
+void Snapshot_AVL_Tree<T>::Snapshot::for_each_in_range(const T &low, const T &high, Function f) const
+{
+    __for_each_in_range(_root, low, high, f);
+}
+
+
+// NODE
+template <typename T>
+Snapshot_AVL_Tree<T>::Node::Node(const T &value, const Node *left, const Node *right):
+    _left(left), _right(right), _value(value),
+    _height(max(left == NULL ? 0 : left->_height, right == NULL ? 0 : right->_height) + 1) {}
+
+#endif // SNAPSHOT_AVL_TREE_H
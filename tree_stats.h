@@ -0,0 +1,96 @@
+#ifndef TREE_STATS_H
+#define TREE_STATS_H
+
+#include <cstddef>
+#include <cstring>
+
+#include "avl_tree.h"
+
+// What one thread's trees did since the last reset. depth_histogram[d]
+// counts the finds, inserts and removes that visited d nodes; deeper
+// descents land in the last bucket.
+struct Tree_Counters {
+    static const unsigned HISTOGRAM_SIZE = 64;
+
+    unsigned long long _compares;
+    unsigned long long _rotations[4];
+    unsigned long long _allocated;
+    unsigned long long _freed;
+    unsigned long long _descents[3];
+    unsigned long long _descent_depth[3];
+    unsigned long long _depth_histogram[HISTOGRAM_SIZE];
+
+    unsigned long long rotations() const;
+    double average_depth(Tree_Operation operation) const;
+};
+
+// Statistics policy counting into thread_local Tree_Counters: no locking
+// and no shared cache lines, so it stays cheap enough to leave on. Each
+// thread reads and resets its own counters.
+//
+//   AVL_Tree<T, allocator<T>, No_Augment<T>, Thread_Stats> tree;
+//   ...
+//   const Tree_Counters & stats = Thread_Stats::local();
+struct Thread_Stats {
+    static Tree_Counters & local();
+    static void reset();
+
+    static void compared();
+    static void rotated(Tree_Rotation rotation);
+    static void allocated(std::size_t count);
+    static void freed(std::size_t count);
+    static void descended(Tree_Operation operation, unsigned depth);
+};
+
+inline unsigned long long Tree_Counters::rotations() const
+{
+    return _rotations[RR_ROTATION] + _rotations[LL_ROTATION] + _rotations[LR_ROTATION] + _rotations[RL_ROTATION];
+}
+
+inline double Tree_Counters::average_depth(Tree_Operation operation) const
+{
+    if(_descents[operation] == 0)
+        return 0;
+    return double(_descent_depth[operation]) / _descents[operation];
+}
+
+inline Tree_Counters &Thread_Stats::local()
+{
+    static thread_local Tree_Counters counters = Tree_Counters();
+    return counters;
+}
+
+inline void Thread_Stats::reset()
+{
+    std::memset(&local(), 0, sizeof(Tree_Counters));
+}
+
+inline void Thread_Stats::compared()
+{
+    local()._compares++;
+}
+
+inline void Thread_Stats::rotated(Tree_Rotation rotation)
+{
+    local()._rotations[rotation]++;
+}
+
+inline void Thread_Stats::allocated(std::size_t count)
+{
+    local()._allocated += count;
+}
+
+inline void Thread_Stats::freed(std::size_t count)
+{
+    local()._freed += count;
+}
+
+inline void Thread_Stats::descended(Tree_Operation operation, unsigned depth)
+{
+    Tree_Counters & counters = local();
+    counters._descents[operation]++;
+    counters._descent_depth[operation] += depth;
+    counters._depth_histogram[depth < Tree_Counters::HISTOGRAM_SIZE ? depth : Tree_Counters::HISTOGRAM_SIZE - 1]++;
+}
+
+#endif // TREE_STATS_H
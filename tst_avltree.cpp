@@ -2,14 +2,124 @@
 #include <QtTest>
 
 #include "avl_tree.h"
+#include "compact_avl_tree.h"
+#include "find_cache.h"
+#include "free_gap_avl_tree.h"
+#include "frozen_index.h"
+#include "interval_set.h"
+#include "interval_tree.h"
+#include "lazy_avl_tree.h"
+#include "mapped_storage.h"
+#include "range_lookup.h"
+#include "sharded_avl_tree.h"
+#include "snapshot_avl_tree.h"
+#include "tree_stats.h"
 
 #include <algorithm>
 using std::random_shuffle;
 
+#include <cstdio>
 #include <cstdlib>
 
+#include <fstream>
+
+#include <memory>
+using std::shared_ptr;
+
+#include <sstream>
+using std::stringstream;
+
+#include <stdexcept>
+
+#include <string>
+using std::string;
+
+#include <thread>
+
 #include "interval.h"
 
+template <typename T>
+struct Counting_Allocator {
+    typedef T value_type;
+    static int allocations;
+
+    Counting_Allocator() {}
+    template <typename U>
+    Counting_Allocator(const Counting_Allocator<U> &) {}
+
+    T * allocate(std::size_t n) {
+        allocations++;
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+    void deallocate(T * p, std::size_t) {
+        ::operator delete(p);
+    }
+};
+template <typename T>
+int Counting_Allocator<T>::allocations = 0;
+template <typename T, typename U>
+bool operator==(const Counting_Allocator<T> &, const Counting_Allocator<U> &) { return true; }
+template <typename T, typename U>
+bool operator!=(const Counting_Allocator<T> &, const Counting_Allocator<U> &) { return false; }
+
+// Range carrying a label, with no invalid() or sameAs(), that can only be
+// moved: the trees must never copy their elements.
+struct Labelled_Range {
+    int _begin;
+    int _end;
+    string _label;
+
+    Labelled_Range(int begin, int end, const string & label = string()): _begin(begin), _end(end), _label(label) {}
+    Labelled_Range(Labelled_Range &&) = default;
+    Labelled_Range & operator=(Labelled_Range &&) = default;
+    Labelled_Range(const Labelled_Range &) = delete;
+    Labelled_Range & operator=(const Labelled_Range &) = delete;
+
+    bool operator<(const Labelled_Range & o) const { return _end < o._begin; }
+    bool operator>(const Labelled_Range & o) const { return _begin > o._end; }
+};
+
+// Range sharing a payload, whose use count tells how many copies are
+// still alive.
+struct Shared_Range {
+    int _begin;
+    int _end;
+    shared_ptr<string> _payload;
+
+    Shared_Range(int begin, int end, const shared_ptr<string> & payload = shared_ptr<string>()): _begin(begin), _end(end), _payload(payload) {}
+
+    bool operator<(const Shared_Range & o) const { return _end < o._begin; }
+    bool operator>(const Shared_Range & o) const { return _begin > o._end; }
+};
+
+// Vector_Storage claiming to be as full as 31-bit links allow.
+template <typename Node>
+class Full_Storage : public Vector_Storage<Node>
+{
+public:
+    std::size_t size() const { return 0x7FFFFFFF; }
+};
+
+// Orders intervals from the highest address down.
+struct Descending_Compare {
+    static int compare(const NonOverlappingInterval & a, const NonOverlappingInterval & b) { return b.compare(a); }
+};
+
+// Takes value out of tree and checks it was the expected element.
+template <typename Tree>
+static bool extracts(Tree & tree, const NonOverlappingInterval & value, const NonOverlappingInterval & expected)
+{
+    NonOverlappingInterval removed = NonOverlappingInterval::invalid();
+    return tree.extract(value, removed) && removed.sameAs(expected);
+}
+
+template <typename Tree>
+static bool finds(Tree & tree, const NonOverlappingInterval & value, const NonOverlappingInterval & expected)
+{
+    NonOverlappingInterval found = NonOverlappingInterval::invalid();
+    return tree.find(value, found) && found.sameAs(expected);
+}
+
 class AVL_Tree_Test : public QObject
 {
     Q_OBJECT
@@ -47,6 +157,76 @@ private Q_SLOTS:
     void removeTheSmallestFromATreeWithTwoElements();
     void removeTheRootFromATreeWithThreeElements();
     void removeTheRootFromATreeWithTwoSubtreesWithThreeElementsEach();
+    void poolRecyclesFreedNodes();
+    void insert1000ElementsAllocatesOnlyAFewBlocks();
+    void assign1000SortedElementsAndFindOne();
+    void assignRejectsUnsortedOrOverlappingRanges();
+    void insertAndRemoveAfterAssign();
+    void compactTreeInsertFindAndRemove();
+    void compactTreeRebalancesLikeAVL_Tree();
+    void compactTreeUsesLessMemory();
+    void compactTreeReleasesRemovedValues();
+    void mappedTreePersistsAcrossReopens();
+    void mappedTreeRefusesDirtyOrForeignFiles();
+    void iterateInOrder();
+    void iterateBackwardsFromEnd();
+    void lowerAndUpperBound();
+    void forEachInRangeVisitsIntersectingIntervals();
+    void checkExistentAndInexistentElements();
+    void findContainingAnswersPointQueries();
+    void findCacheHitsUntilANodeIsFreed();
+    void frozenIndexFindsWhatTheTreeFinds();
+    void moveOnlyElementsAreNeverCopied();
+    void threeWayCompare();
+    void customCompareOrdersTheTree();
+    void saveAndLoadRoundTrip();
+    void loadRejectsDamagedSnapshots();
+    void allocateFirstFitFillsTheLowestGap();
+    void allocateBestFitPicksTheSmallestGap();
+    void allocateAtOrAfterAnAddress();
+    void allocateFailsWhenNoGapIsLargeEnough();
+    void removingAnAllocationMergesItsGaps();
+    void intervalSetMergesAdjacentAndOverlappingRanges();
+    void intervalSetEraseSplitsPartiallyCoveredRanges();
+    void intervalTreeHoldsOverlappingRanges();
+    void intervalTreeMatchesAScanAfterRotations();
+    void selectTheKthSmallestElement();
+    void rankCountsSmallerElements();
+    void countInRangeAfterInsertsAndRemoves();
+    void insertBatchReportsPerElementSuccess();
+    void removeBatchReportsPerElementSuccess();
+    void insertBatchKeepsTheTreeBalanced();
+    void hintedInsertStartsFromTheHint();
+    void lazyTreeSkipsRemovedElements();
+    void lazyTreeCompactsPastItsThreshold();
+    void splitAtAKey();
+    void joinTreesBackTogether();
+    void joinTreesFromDifferentPools();
+    void splitHalvesChangeOnSeparateThreads();
+    void unionKeepsOwnElementsOnOverlap();
+    void intersectAndSubtractPartitionATree();
+    void setOperationsOnLargeTrees();
+    void snapshotDoesNotSeeLaterWrites();
+    void snapshotReadersRunAlongsideAWriter();
+    void shardedTreeHandlesRangesAcrossShards();
+    void shardedTreeWritersOnDifferentRegions();
+    void statsCountRotationsNodesAndDescents();
+    void benchmarkInsert();
+    void benchmarkInsertSortedWithHint();
+    void benchmarkLoad();
+    void benchmarkAttachMapped();
+    void benchmarkFind();
+    void benchmarkFindWithStats();
+    void benchmarkFindHotWithCache();
+    void benchmarkFindContainingBatch();
+    void benchmarkRemove();
+    void benchmarkRemoveLazy();
+    void benchmarkFindCompact();
+    void benchmarkFindFrozen();
+    void benchmarkOverlaps();
+    void benchmarkInsertBatch();
+    void benchmarkUnion();
+    void benchmarkShardedThreadScaling();
 };
 
 AVL_Tree_Test::AVL_Tree_Test()
@@ -68,7 +248,7 @@ void AVL_Tree_Test::checkRoot()
     AVL_Tree<NonOverlappingInterval> rtree;
     NonOverlappingInterval root(100, 300);
     rtree.insert(root);
-    QVERIFY(rtree.root() == root);
+    QVERIFY(*rtree.root() == root);
 }
 
 void AVL_Tree_Test::insertLessThanRootWithoutOverlap()
@@ -107,7 +287,7 @@ void AVL_Tree_Test::checkIfRangeCanBeInsertedBeforeRoot()
 {
     AVL_Tree<NonOverlappingInterval> rtree ;
     QVERIFY(rtree.insert(NonOverlappingInterval(100, 300)));
-    QVERIFY(rtree.find(NonOverlappingInterval(50, 49)).sameAs(NonOverlappingInterval::invalid()));
+    QVERIFY(rtree.find(NonOverlappingInterval(50, 49)) == rtree.end());
 }
 
 void AVL_Tree_Test::checkIfRangeCanBeInsertedAfterRoot()
@@ -120,14 +300,14 @@ void AVL_Tree_Test::checkIfRangeCannotBeInsertedBeforeRoot()
 {
     AVL_Tree<NonOverlappingInterval> rtree;
     rtree.insert(NonOverlappingInterval(100, 300));
-    QVERIFY(rtree.find(NonOverlappingInterval(50, 100)).sameAs(NonOverlappingInterval(100, 300)));
+    QVERIFY(rtree.find(NonOverlappingInterval(50, 100))->sameAs(NonOverlappingInterval(100, 300)));
 }
 
 void AVL_Tree_Test::checkIfRangeCannotBeInsertedAfterRoot()
 {
     AVL_Tree<NonOverlappingInterval> rtree;
     rtree.insert(NonOverlappingInterval(100, 300));
-    QVERIFY(rtree.find(NonOverlappingInterval(390, 50)).sameAs(NonOverlappingInterval(100, 300)));
+    QVERIFY(rtree.find(NonOverlappingInterval(390, 50))->sameAs(NonOverlappingInterval(100, 300)));
 }
 
 
@@ -139,13 +319,13 @@ void AVL_Tree_Test::rootChangeWithLeftRotation()
     NonOverlappingInterval c(20, 9);
     NonOverlappingInterval d(30, 9);
     rtree.insert(a);
-    QVERIFY(rtree.root().sameAs(a));
+    QVERIFY(rtree.root()->sameAs(a));
     rtree.insert(b);
-    QVERIFY(rtree.root().sameAs(a));
+    QVERIFY(rtree.root()->sameAs(a));
     rtree.insert(c);
-    QVERIFY(rtree.root().sameAs(b));
+    QVERIFY(rtree.root()->sameAs(b));
     rtree.insert(d);
-    QVERIFY(rtree.root().sameAs(b));
+    QVERIFY(rtree.root()->sameAs(b));
 }
 
 void AVL_Tree_Test::rootChangeWithRightRotation()
@@ -156,13 +336,13 @@ void AVL_Tree_Test::rootChangeWithRightRotation()
     NonOverlappingInterval c(20, 9);
     NonOverlappingInterval d(30, 9);
     rtree.insert(d);
-    QVERIFY(rtree.root().sameAs(d));
+    QVERIFY(rtree.root()->sameAs(d));
     rtree.insert(c);
-    QVERIFY(rtree.root().sameAs(d));
+    QVERIFY(rtree.root()->sameAs(d));
     rtree.insert(b);
-    QVERIFY(rtree.root().sameAs(c));
+    QVERIFY(rtree.root()->sameAs(c));
     rtree.insert(a);
-    QVERIFY(rtree.root().sameAs(c));
+    QVERIFY(rtree.root()->sameAs(c));
 }
 
 void AVL_Tree_Test::rootChangeWithDoubleLeftRotation()
@@ -173,11 +353,11 @@ void AVL_Tree_Test::rootChangeWithDoubleLeftRotation()
     NonOverlappingInterval c(20, 9);
 
     rtree.insert(a);
-    QVERIFY(rtree.root().sameAs(a));
+    QVERIFY(rtree.root()->sameAs(a));
     rtree.insert(c);
-    QVERIFY(rtree.root().sameAs(a));
+    QVERIFY(rtree.root()->sameAs(a));
     rtree.insert(b);
-    QVERIFY(rtree.root().sameAs(b));
+    QVERIFY(rtree.root()->sameAs(b));
 }
 
 void AVL_Tree_Test::rootChangeWithDoubleRightRotation()
@@ -187,11 +367,11 @@ void AVL_Tree_Test::rootChangeWithDoubleRightRotation()
     NonOverlappingInterval b(10, 9);
     NonOverlappingInterval c(20, 9);
     rtree.insert(c);
-    QVERIFY(rtree.root().sameAs(c));
+    QVERIFY(rtree.root()->sameAs(c));
     rtree.insert(a);
-    QVERIFY(rtree.root().sameAs(c));
+    QVERIFY(rtree.root()->sameAs(c));
     rtree.insert(b);
-    QVERIFY(rtree.root().sameAs(b));
+    QVERIFY(rtree.root()->sameAs(b));
 }
 
 void AVL_Tree_Test::insertZeroToSix()
@@ -205,19 +385,19 @@ void AVL_Tree_Test::insertZeroToSix()
     NonOverlappingInterval f(50, 9);
     NonOverlappingInterval g(60, 9);
     QVERIFY(rtree.insert(a));
-    QVERIFY(rtree.root().sameAs(a));
+    QVERIFY(rtree.root()->sameAs(a));
     QVERIFY(rtree.insert(b));
-    QVERIFY(rtree.root().sameAs(a));
+    QVERIFY(rtree.root()->sameAs(a));
     QVERIFY(rtree.insert(c));
-    QVERIFY(rtree.root().sameAs(b));
+    QVERIFY(rtree.root()->sameAs(b));
     QVERIFY(rtree.insert(d));
-    QVERIFY(rtree.root().sameAs(b));
+    QVERIFY(rtree.root()->sameAs(b));
     QVERIFY(rtree.insert(e));
-    QVERIFY(rtree.root().sameAs(b));
+    QVERIFY(rtree.root()->sameAs(b));
     QVERIFY(rtree.insert(f));
-    QVERIFY(rtree.root().sameAs(d));
+    QVERIFY(rtree.root()->sameAs(d));
     QVERIFY(rtree.insert(g));
-    QVERIFY(rtree.root().sameAs(d));
+    QVERIFY(rtree.root()->sameAs(d));
 }
 
 
@@ -258,14 +438,14 @@ void AVL_Tree_Test::findingAValue()
     QVERIFY(rtree.insert(c));
     QVERIFY(rtree.insert(b));
     QVERIFY(rtree.insert(a));
-    QVERIFY(rtree.find(NonOverlappingInterval(32, 5)).sameAs(NonOverlappingInterval(30, 9)));
+    QVERIFY(rtree.find(NonOverlappingInterval(32, 5))->sameAs(NonOverlappingInterval(30, 9)));
 }
 
 
 void AVL_Tree_Test::checkRootOfAnEmptyTree()
 {
     AVL_Tree<NonOverlappingInterval> rtree;
-    QVERIFY(rtree.root().sameAs(NonOverlappingInterval::invalid()));
+    QVERIFY(rtree.root() == NULL);
 }
 
 
@@ -280,8 +460,9 @@ void AVL_Tree_Test::findExistentElement()
     QVERIFY(rtree.insert(b));
     QVERIFY(rtree.insert(c));
     QVERIFY(rtree.insert(d));
-    const NonOverlappingInterval result = rtree.find(NonOverlappingInterval(33, 5));
-    QVERIFY(result.sameAs(d));
+    AVL_Tree<NonOverlappingInterval>::const_iterator result = rtree.find(NonOverlappingInterval(33, 5));
+    QVERIFY(result != rtree.end());
+    QVERIFY(result->sameAs(d));
 }
 
 void AVL_Tree_Test::findInexistentElement()
@@ -293,10 +474,20 @@ void AVL_Tree_Test::findInexistentElement()
     rtree.insert(a);
     rtree.insert(b);
     rtree.insert(c);
-    const NonOverlappingInterval result = rtree.find(NonOverlappingInterval(30, 5));
-    QVERIFY(result.sameAs(NonOverlappingInterval::invalid()));
+    QVERIFY(rtree.find(NonOverlappingInterval(30, 5)) == rtree.end());
 }
 int myrandom (int i) { return std::rand()%i;}
+
+static std::vector<int> shuffledKeys(unsigned n)
+{
+    std::srand(0);
+    std::vector<int> keys;
+    for(unsigned i = 0; i < n; i++)
+        keys.push_back(i*10);
+    random_shuffle(keys.begin(), keys.end(), myrandom);
+    return keys;
+}
+
 void AVL_Tree_Test::insert1000NonSortedElementsAndFindOne()
 {
     std::srand (0);
@@ -308,8 +499,7 @@ void AVL_Tree_Test::insert1000NonSortedElementsAndFindOne()
     for(unsigned i = 0; i < mySet.size(); i++)
         QVERIFY(row.insert(NonOverlappingInterval(mySet[i].first, mySet[i].second)));
     QVERIFY(row.size() == mySet.size());
-    const NonOverlappingInterval result = row.find(NonOverlappingInterval(51, 2));
-    QVERIFY(result.sameAs(NonOverlappingInterval(50, 5)));
+    QVERIFY(row.find(NonOverlappingInterval(51, 2))->sameAs(NonOverlappingInterval(50, 5)));
 }
 
 void AVL_Tree_Test::insert1000SortedElementsAndFindOne()
@@ -318,23 +508,22 @@ void AVL_Tree_Test::insert1000SortedElementsAndFindOne()
     for(unsigned i = 0; i < 1000; i++)
         QVERIFY(rtree.insert(NonOverlappingInterval(i*10, 5)));
     QVERIFY(rtree.size() == 1000);
-    NonOverlappingInterval result = rtree.find(NonOverlappingInterval(51, 2));
-    QVERIFY(result.sameAs(NonOverlappingInterval(50, 5)));
+    QVERIFY(rtree.find(NonOverlappingInterval(51, 2))->sameAs(NonOverlappingInterval(50, 5)));
 }
 
 void AVL_Tree_Test::removeFromAEmptyTree()
 {
     AVL_Tree<NonOverlappingInterval> rtree;
-    NonOverlappingInterval value_removed = rtree.remove(NonOverlappingInterval(10, 1));
+    QVERIFY(!rtree.remove(NonOverlappingInterval(10, 1)));
     QVERIFY(rtree.size() == 0);
-    QVERIFY(value_removed.sameAs(NonOverlappingInterval::invalid()));
 }
 
 void AVL_Tree_Test::removeRootFromATreeWithASingleElement()
 {
     AVL_Tree<NonOverlappingInterval> rtree;
     QVERIFY(rtree.insert(NonOverlappingInterval(10, 300)));
-    NonOverlappingInterval value_removed = rtree.remove(NonOverlappingInterval(13, 1));
+    NonOverlappingInterval value_removed = NonOverlappingInterval::invalid();
+    QVERIFY(rtree.extract(NonOverlappingInterval(13, 1), value_removed));
     QVERIFY(rtree.empty());
     QVERIFY(value_removed.sameAs(NonOverlappingInterval(10, 300)));
 }
@@ -347,10 +536,11 @@ void AVL_Tree_Test::removeTheBiggestFromATreeWithTwoElements()
     rtree.insert(a);
     rtree.insert(b);
     QVERIFY(rtree.size() == 2);
-    const NonOverlappingInterval value_removed = rtree.remove(NonOverlappingInterval(10, 1));
+    NonOverlappingInterval value_removed = NonOverlappingInterval::invalid();
+    QVERIFY(rtree.extract(NonOverlappingInterval(10, 1), value_removed));
     QVERIFY(rtree.size() == 1);
     QVERIFY(value_removed.sameAs(b));
-    QVERIFY(rtree.root().sameAs(a));
+    QVERIFY(rtree.root()->sameAs(a));
 }
 
 void AVL_Tree_Test::removeTheSmallestFromATreeWithTwoElements()
@@ -361,10 +551,11 @@ void AVL_Tree_Test::removeTheSmallestFromATreeWithTwoElements()
     rtree.insert(a);
     rtree.insert(b);
     QVERIFY(rtree.size() == 2);
-    const NonOverlappingInterval value_removed = rtree.remove(NonOverlappingInterval(2, 1));
+    NonOverlappingInterval value_removed = NonOverlappingInterval::invalid();
+    QVERIFY(rtree.extract(NonOverlappingInterval(2, 1), value_removed));
     QVERIFY(rtree.size() == 1);
     QVERIFY(value_removed.sameAs(a));
-    QVERIFY(rtree.root().sameAs(b));
+    QVERIFY(rtree.root()->sameAs(b));
 }
 
 void AVL_Tree_Test::removeTheRootFromATreeWithThreeElements()
@@ -377,11 +568,12 @@ void AVL_Tree_Test::removeTheRootFromATreeWithThreeElements()
     rtree.insert(b);
     rtree.insert(c);
     QVERIFY(rtree.size() == 3);
-    const NonOverlappingInterval value_removed = rtree.remove(NonOverlappingInterval(13, 1));
+    NonOverlappingInterval value_removed = NonOverlappingInterval::invalid();
+    QVERIFY(rtree.extract(NonOverlappingInterval(13, 1), value_removed));
     QVERIFY(rtree.size() == 2);
     QVERIFY(value_removed.sameAs(b));
-    QVERIFY(rtree.root().sameAs(c));
-    QVERIFY(rtree.find(NonOverlappingInterval(5, 2)).sameAs(a));
+    QVERIFY(rtree.root()->sameAs(c));
+    QVERIFY(rtree.find(NonOverlappingInterval(5, 2))->sameAs(a));
 }
 
 void AVL_Tree_Test::removeTheRootFromATreeWithTwoSubtreesWithThreeElementsEach()
@@ -405,14 +597,1499 @@ void AVL_Tree_Test::removeTheRootFromATreeWithTwoSubtreesWithThreeElementsEach()
 
 
     QVERIFY(rtree.size() == 7);
-    QVERIFY(rtree.root().sameAs(a));
-    NonOverlappingInterval value_removed = rtree.remove(NonOverlappingInterval(4005, 1));
+    QVERIFY(rtree.root()->sameAs(a));
+    NonOverlappingInterval value_removed = NonOverlappingInterval::invalid();
+    QVERIFY(rtree.extract(NonOverlappingInterval(4005, 1), value_removed));
     QVERIFY(rtree.size() == 6);
     QVERIFY(value_removed.sameAs(a));
-    QVERIFY(rtree.root().sameAs(f));
-    QVERIFY(rtree.find(NonOverlappingInterval(6005, 3)).sameAs(c));
+    QVERIFY(rtree.root()->sameAs(f));
+    QVERIFY(rtree.find(NonOverlappingInterval(6005, 3))->sameAs(c));
+}
+
+
+void AVL_Tree_Test::poolRecyclesFreedNodes()
+{
+    Node_Pool<NonOverlappingInterval> pool;
+    NonOverlappingInterval * a = pool.allocate();
+    NonOverlappingInterval * b = pool.allocate();
+    QVERIFY(a != b);
+    QVERIFY(pool.capacity() > 1);
+    pool.deallocate(a);
+    QVERIFY(pool.allocate() == a);
+    pool.release();
+    QVERIFY(pool.capacity() == 0);
+}
+
+void AVL_Tree_Test::insert1000ElementsAllocatesOnlyAFewBlocks()
+{
+    Counting_Allocator<NonOverlappingInterval>::allocations = 0;
+    {
+        AVL_Tree<NonOverlappingInterval, Counting_Allocator<NonOverlappingInterval> > rtree;
+        for(unsigned i = 0; i < 1000; i++)
+            QVERIFY(rtree.insert(NonOverlappingInterval(i*10, 5)));
+        for(unsigned i = 0; i < 1000; i += 2)
+            QVERIFY(extracts(rtree, NonOverlappingInterval(i*10, 1), NonOverlappingInterval(i*10, 5)));
+        for(unsigned i = 0; i < 1000; i += 2)
+            QVERIFY(rtree.insert(NonOverlappingInterval(i*10, 5)));
+        QVERIFY(rtree.size() == 1000);
+    }
+    QVERIFY(Counting_Allocator<NonOverlappingInterval>::allocations < 10);
+}
+void AVL_Tree_Test::assign1000SortedElementsAndFindOne()
+{
+    std::vector<NonOverlappingInterval> sorted;
+    for(unsigned i = 0; i < 1000; i++)
+        sorted.push_back(NonOverlappingInterval(i*10, 5));
+    AVL_Tree<NonOverlappingInterval> rtree;
+    QVERIFY(rtree.assign(sorted.begin(), sorted.end()));
+    QVERIFY(rtree.size() == 1000);
+    QVERIFY(rtree.root()->sameAs(NonOverlappingInterval(5000, 5)));
+    for(unsigned i = 0; i < 1000; i++)
+        QVERIFY(rtree.find(NonOverlappingInterval(i*10 + 1, 2))->sameAs(sorted[i]));
+    QVERIFY(rtree.find(NonOverlappingInterval(6, 2)) == rtree.end());
+}
+
+void AVL_Tree_Test::assignRejectsUnsortedOrOverlappingRanges()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    QVERIFY(rtree.insert(NonOverlappingInterval(100, 300)));
+
+    std::vector<NonOverlappingInterval> unsorted;
+    unsorted.push_back(NonOverlappingInterval(10, 5));
+    unsorted.push_back(NonOverlappingInterval(0, 5));
+    QVERIFY(!rtree.assign(unsorted.begin(), unsorted.end()));
+
+    std::vector<NonOverlappingInterval> overlapping;
+    overlapping.push_back(NonOverlappingInterval(0, 10));
+    overlapping.push_back(NonOverlappingInterval(5, 10));
+    QVERIFY(!rtree.assign(overlapping.begin(), overlapping.end()));
+
+    QVERIFY(rtree.size() == 1);
+    QVERIFY(rtree.root()->sameAs(NonOverlappingInterval(100, 300)));
+
+    std::vector<NonOverlappingInterval> empty;
+    QVERIFY(rtree.assign(empty.begin(), empty.end()));
+    QVERIFY(rtree.empty());
+}
+
+void AVL_Tree_Test::insertAndRemoveAfterAssign()
+{
+    std::vector<NonOverlappingInterval> sorted;
+    for(unsigned i = 0; i < 7; i++)
+        sorted.push_back(NonOverlappingInterval(i*10, 9));
+    AVL_Tree<NonOverlappingInterval> rtree;
+    QVERIFY(rtree.assign(sorted.begin(), sorted.end()));
+    QVERIFY(rtree.root()->sameAs(NonOverlappingInterval(30, 9)));
+    QVERIFY(rtree.insert(NonOverlappingInterval(70, 9)));
+    QVERIFY(rtree.insert(NonOverlappingInterval(80, 9)));
+    QVERIFY(rtree.root()->sameAs(NonOverlappingInterval(30, 9)));
+    QVERIFY(extracts(rtree, NonOverlappingInterval(0, 1), sorted[0]));
+    QVERIFY(extracts(rtree, NonOverlappingInterval(20, 1), sorted[2]));
+    QVERIFY(rtree.size() == 7);
+    QVERIFY(rtree.find(NonOverlappingInterval(85, 1))->sameAs(NonOverlappingInterval(80, 9)));
+}
+void AVL_Tree_Test::compactTreeInsertFindAndRemove()
+{
+    Compact_AVL_Tree<NonOverlappingInterval> rtree;
+    QVERIFY(rtree.empty());
+    QVERIFY(rtree.root() == NULL);
+    QVERIFY(rtree.insert(NonOverlappingInterval(100, 300)));
+    QVERIFY(!rtree.insert(NonOverlappingInterval(80, 30)));
+    QVERIFY(rtree.insert(NonOverlappingInterval(50, 10)));
+    QVERIFY(rtree.insert(NonOverlappingInterval(401, 30)));
+    QVERIFY(rtree.size() == 3);
+    QVERIFY(rtree.find(NonOverlappingInterval(390, 50))->sameAs(NonOverlappingInterval(100, 300)));
+    QVERIFY(rtree.find(NonOverlappingInterval(60, 5)) == NULL);
+    QVERIFY(extracts(rtree, NonOverlappingInterval(105, 1), NonOverlappingInterval(100, 300)));
+    QVERIFY(!rtree.remove(NonOverlappingInterval(105, 1)));
+    QVERIFY(rtree.size() == 2);
+    QVERIFY(rtree.find(NonOverlappingInterval(55, 1))->sameAs(NonOverlappingInterval(50, 10)));
+
+    Compact_AVL_Tree<NonOverlappingInterval, Full_Storage> full;
+    QVERIFY_EXCEPTION_THROWN(full.insert(NonOverlappingInterval(0, 5)), std::length_error);
+    QVERIFY(full.empty() && full.root() == NULL);
+}
+
+void AVL_Tree_Test::compactTreeRebalancesLikeAVL_Tree()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    Compact_AVL_Tree<NonOverlappingInterval> compact;
+    const std::vector<int> keys = shuffledKeys(1000);
+    for(unsigned i = 0; i < keys.size(); i++)
+    {
+        QVERIFY(rtree.insert(NonOverlappingInterval(keys[i], 5)));
+        QVERIFY(compact.insert(NonOverlappingInterval(keys[i], 5)));
+        QVERIFY(compact.root()->sameAs(*rtree.root()));
+    }
+    for(unsigned i = 0; i < keys.size(); i += 3)
+    {
+        QVERIFY(extracts(compact, NonOverlappingInterval(keys[i], 1), NonOverlappingInterval(keys[i], 5)));
+        QVERIFY(compact.find(NonOverlappingInterval(keys[i], 1)) == NULL);
+    }
+    QVERIFY(compact.size() == 666);
+}
+
+void AVL_Tree_Test::compactTreeUsesLessMemory()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    Compact_AVL_Tree<NonOverlappingInterval> compact;
+    compact.reserve(100000);
+    for(unsigned i = 0; i < 100000; i++)
+    {
+        rtree.insert(NonOverlappingInterval(i*10, 5));
+        compact.insert(NonOverlappingInterval(i*10, 5));
+    }
+    QVERIFY(compact.memory_usage() * 2 <= rtree.memory_usage());
+}
+
+// A removed element's slot waits on the free list; what the element owned
+// must not wait with it.
+void AVL_Tree_Test::compactTreeReleasesRemovedValues()
+{
+    shared_ptr<string> payload(new string(100, 'p'));
+    Compact_AVL_Tree<Shared_Range> compact;
+    for(int i = 0; i < 10; i++)
+        QVERIFY(compact.insert(Shared_Range(i*10, i*10 + 4, payload)));
+    QVERIFY(payload.use_count() == 11);
+    QVERIFY(compact.remove(Shared_Range(32, 32)));
+    QVERIFY(payload.use_count() == 10);
+    {
+        Shared_Range removed(0, 0);
+        QVERIFY(compact.extract(Shared_Range(51, 51), removed));
+        QVERIFY(removed._payload == payload);
+    }
+    QVERIFY(payload.use_count() == 9);
+    QVERIFY(compact.insert(Shared_Range(30, 34, payload)));
+    QVERIFY(payload.use_count() == 10);
+    QVERIFY(compact.size() == 9);
+}
+
+void AVL_Tree_Test::mappedTreePersistsAcrossReopens()
+{
+    typedef Compact_AVL_Tree<NonOverlappingInterval, Mapped_Storage> Mapped_Tree;
+    const char * path = "tst_avltree_mapped.avl";
+    std::remove(path);
+    const std::vector<int> keys = shuffledKeys(3000);
+    {
+        Mapped_Tree rtree(path);
+        QVERIFY(rtree.is_open());
+        QVERIFY(rtree.empty());
+        for(unsigned i = 0; i < keys.size(); i++)
+            QVERIFY(rtree.insert(NonOverlappingInterval(keys[i], 5)));
+        for(unsigned i = 0; i < 1000; i++)
+            QVERIFY(rtree.remove(NonOverlappingInterval(i*10, 1)));
+        QVERIFY(rtree.flush());
+    }
+    {
+        Mapped_Tree rtree(path, true);
+        QVERIFY(rtree.is_open());
+        QVERIFY(rtree.size() == 2000);
+        QVERIFY(rtree.find(NonOverlappingInterval(5, 1)) == NULL);
+        QVERIFY(rtree.find(NonOverlappingInterval(20002, 1))->sameAs(NonOverlappingInterval(20000, 5)));
+        QVERIFY(!rtree.insert(NonOverlappingInterval(5, 1)));
+        QVERIFY(!rtree.remove(NonOverlappingInterval(20002, 1)));
+        rtree.clear();
+        QVERIFY(rtree.size() == 2000);
+    }
+    {
+        Mapped_Tree rtree(path);
+        for(unsigned i = 0; i < 1000; i++)
+            QVERIFY(rtree.insert(NonOverlappingInterval(i*10, 5)));
+    }
+    Mapped_Tree rtree(path, true);
+    QVERIFY(rtree.size() == 3000);
+    for(unsigned i = 0; i < 3000; i++)
+        QVERIFY(rtree.find(NonOverlappingInterval(i*10 + 2, 1))->sameAs(NonOverlappingInterval(i*10, 5)));
+    std::remove(path);
+}
+
+void AVL_Tree_Test::mappedTreeRefusesDirtyOrForeignFiles()
+{
+    typedef Compact_AVL_Tree<NonOverlappingInterval, Mapped_Storage> Mapped_Tree;
+    const char * path = "tst_avltree_mapped.avl";
+    const char * copy = "tst_avltree_mapped_copy.avl";
+    std::remove(path);
+    {
+        Mapped_Tree rtree(path);
+        QVERIFY(rtree.insert(NonOverlappingInterval(0, 5)));
+        QVERIFY(rtree.flush());
+        QVERIFY(rtree.insert(NonOverlappingInterval(10, 5)));
+        // What a crash before the next flush would leave behind.
+        std::ifstream in(path, std::ios::binary);
+        std::ofstream out(copy, std::ios::binary | std::ios::trunc);
+        out << in.rdbuf();
+    }
+    Mapped_Tree dirty(copy);
+    QVERIFY(!dirty.is_open());
+    QVERIFY(!dirty.insert(NonOverlappingInterval(20, 5)));
+
+    {
+        std::ofstream out(copy, std::ios::binary | std::ios::trunc);
+        out << string(100, 'x');
+    }
+    Mapped_Tree foreign(copy);
+    QVERIFY(!foreign.is_open());
+    QVERIFY(foreign.empty());
+    std::ifstream in(copy, std::ios::binary | std::ios::ate);
+    QVERIFY(in.tellg() == 100);
+
+    // Marked clean, but the root (16 bytes in) or the free list head (20
+    // bytes in) points past the stored nodes.
+    for(int offset = 16; offset <= 20; offset += 4)
+    {
+        {
+            std::ifstream original(path, std::ios::binary);
+            std::ofstream out(copy, std::ios::binary | std::ios::trunc);
+            out << original.rdbuf();
+        }
+        {
+            std::fstream patch(copy, std::ios::binary | std::ios::in | std::ios::out);
+            patch.seekp(offset);
+            uint32_t index = 2;
+            patch.write(reinterpret_cast<const char *>(&index), sizeof(index));
+        }
+        Mapped_Tree stale(copy);
+        QVERIFY(!stale.is_open());
+        QVERIFY(stale.empty());
+    }
+
+    Mapped_Tree clean(path, true);
+    QVERIFY(clean.is_open());
+    QVERIFY(clean.size() == 2);
+    std::remove(path);
+    std::remove(copy);
+}
+void AVL_Tree_Test::iterateInOrder()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    QVERIFY(rtree.begin() == rtree.end());
+    const std::vector<int> keys = shuffledKeys(1000);
+    for(unsigned i = 0; i < keys.size(); i++)
+        QVERIFY(rtree.insert(NonOverlappingInterval(keys[i], 5)));
+    for(unsigned i = 0; i < keys.size(); i += 2)
+        rtree.remove(NonOverlappingInterval(keys[i], 1));
+    int previous = -1;
+    unsigned visited = 0;
+    for(AVL_Tree<NonOverlappingInterval>::const_iterator it = rtree.begin(); it != rtree.end(); ++it)
+    {
+        QVERIFY(it->begin() > previous);
+        previous = it->begin();
+        visited++;
+    }
+    QVERIFY(visited == rtree.size());
+}
+
+void AVL_Tree_Test::iterateBackwardsFromEnd()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < 100; i++)
+        QVERIFY(rtree.insert(NonOverlappingInterval(i*10, 5)));
+    AVL_Tree<NonOverlappingInterval>::const_iterator it = rtree.end();
+    for(int i = 99; i >= 0; i--)
+    {
+        --it;
+        QVERIFY(it->sameAs(NonOverlappingInterval(i*10, 5)));
+    }
+    QVERIFY(it == rtree.begin());
+}
+
+void AVL_Tree_Test::lowerAndUpperBound()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    NonOverlappingInterval a(0, 9);
+    NonOverlappingInterval b(10, 9);
+    NonOverlappingInterval c(20, 9);
+    rtree.insert(a);
+    rtree.insert(b);
+    rtree.insert(c);
+    QVERIFY(rtree.lower_bound(NonOverlappingInterval(12, 1))->sameAs(b));
+    QVERIFY(rtree.upper_bound(NonOverlappingInterval(12, 1))->sameAs(c));
+    QVERIFY(rtree.lower_bound(NonOverlappingInterval(19, 1))->sameAs(c));
+    QVERIFY(rtree.lower_bound(NonOverlappingInterval(-5, 1))->sameAs(a));
+    QVERIFY(rtree.lower_bound(NonOverlappingInterval(29, 1)) == rtree.end());
+    QVERIFY(rtree.upper_bound(NonOverlappingInterval(20, 1)) == rtree.end());
+}
+
+void AVL_Tree_Test::forEachInRangeVisitsIntersectingIntervals()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < 1000; i++)
+        QVERIFY(rtree.insert(NonOverlappingInterval(i*10, 5)));
+    std::vector<NonOverlappingInterval> visited;
+    rtree.for_each_in_range(NonOverlappingInterval(103, 1), NonOverlappingInterval(147, 1),
+                            [&visited](const NonOverlappingInterval & interval) { visited.push_back(interval); });
+    QVERIFY(visited.size() == 5);
+    QVERIFY(visited.front().sameAs(NonOverlappingInterval(100, 5)));
+    QVERIFY(visited.back().sameAs(NonOverlappingInterval(140, 5)));
+    visited.clear();
+    rtree.for_each_in_range(NonOverlappingInterval(106, 1), NonOverlappingInterval(108, 1),
+                            [&visited](const NonOverlappingInterval & interval) { visited.push_back(interval); });
+    QVERIFY(visited.empty());
+}
+
+void AVL_Tree_Test::checkExistentAndInexistentElements()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    QVERIFY(!rtree.check(NonOverlappingInterval(10, 1)));
+    rtree.insert(NonOverlappingInterval(0, 9));
+    rtree.insert(NonOverlappingInterval(20, 9));
+    QVERIFY(rtree.check(NonOverlappingInterval(5, 1)));
+    QVERIFY(rtree.check(NonOverlappingInterval(8, 15)));
+    QVERIFY(!rtree.check(NonOverlappingInterval(10, 5)));
+}
+
+void AVL_Tree_Test::findContainingAnswersPointQueries()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    QVERIFY(find_containing(rtree, 0) == rtree.end());
+    for(int i = 0; i < 1000; i++)
+        rtree.insert(NonOverlappingInterval(i*10, 1 + i % 9));
+    QVERIFY(find_containing(rtree, 0)->begin() == 0);
+    QVERIFY(find_containing(rtree, 5) == rtree.end());
+    QVERIFY(find_containing(rtree, 5003)->begin() == 5000);
+    QVERIFY(find_containing(rtree, -1) == rtree.end());
+    QVERIFY(find_containing(rtree, 10000) == rtree.end());
+
+    std::srand(24);
+    std::vector<int> addresses;
+    for(int i = 0; i < 3000; i++)
+        addresses.push_back(std::rand() % 10100 - 50);
+    for(int pass = 0; pass < 2; pass++)
+    {
+        std::vector<AVL_Tree<NonOverlappingInterval>::const_iterator> found;
+        find_containing_batch(rtree, addresses.begin(), addresses.end(), std::back_inserter(found));
+        QVERIFY(found.size() == addresses.size());
+        for(unsigned i = 0; i < addresses.size(); i++)
+        {
+            AVL_Tree<NonOverlappingInterval>::const_iterator expected = rtree.find(NonOverlappingInterval(addresses[i], 1));
+            QVERIFY(found[i] == expected);
+        }
+        std::sort(addresses.begin(), addresses.end());
+        addresses.resize(100);
+    }
+}
+
+void AVL_Tree_Test::findCacheHitsUntilANodeIsFreed()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    for(int i = 0; i < 100; i++)
+        rtree.insert(NonOverlappingInterval(i*10, 5));
+    Find_Cache<AVL_Tree<NonOverlappingInterval> > cache(rtree);
+    QVERIFY(cache.find(NonOverlappingInterval(501, 1))->begin() == 500);
+    QVERIFY(cache.find(NonOverlappingInterval(503, 2))->begin() == 500);
+    QVERIFY(cache.find(NonOverlappingInterval(507, 1)) == rtree.end());
+    QVERIFY(cache.hits() == 1 && cache.misses() == 2);
+    QVERIFY(cache.find(NonOverlappingInterval(200, 1))->begin() == 200);
+    QVERIFY(rtree.insert(NonOverlappingInterval(1000, 5)));
+    QVERIFY(cache.find(NonOverlappingInterval(204, 1))->begin() == 200);
+    QVERIFY(cache.hits() == 2);
+    QVERIFY(rtree.remove(NonOverlappingInterval(200, 1)));
+    QVERIFY(cache.find(NonOverlappingInterval(202, 1)) == rtree.end());
+    QVERIFY(cache.hits() == 2 && cache.misses() == 4);
+    cache.reset_counters();
+    QVERIFY(cache.hits() == 0 && cache.misses() == 0);
+}
+
+void AVL_Tree_Test::frozenIndexFindsWhatTheTreeFinds()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    QVERIFY(freeze(rtree).find(0) == NULL);
+    for(int n = 1; n <= 5000; n = n * 3 + 1)
+    {
+        rtree.clear();
+        for(int i = 0; i < n; i++)
+            rtree.insert(NonOverlappingInterval(i * 10, 1 + i % 7));
+        Frozen_Index<NonOverlappingInterval> index = freeze(rtree);
+        QVERIFY(index.size() == unsigned(n));
+        for(int address = -5; address < n * 10 + 5; address++)
+        {
+            AVL_Tree<NonOverlappingInterval>::const_iterator expected = rtree.find(NonOverlappingInterval(address, 1));
+            const NonOverlappingInterval * found = index.find(address);
+            QVERIFY(expected == rtree.end() ? found == NULL : found != NULL && found->sameAs(*expected));
+            found = index.find(NonOverlappingInterval(address, 3));
+            QVERIFY((found != NULL) == rtree.check(NonOverlappingInterval(address, 3)));
+        }
+    }
+    rtree.insert(NonOverlappingInterval(numeric_limits<int>::max() - 4, 5));
+    Frozen_Index<NonOverlappingInterval> index = freeze(rtree);
+    QVERIFY(index.find(numeric_limits<int>::max()) != NULL);
+    QVERIFY(index.find(numeric_limits<int>::max() - 5) == NULL);
+}
+
+void AVL_Tree_Test::threeWayCompare()
+{
+    NonOverlappingInterval a(0, 10);
+    QVERIFY(a.compare(NonOverlappingInterval(10, 5)) < 0);
+    QVERIFY(a.compare(NonOverlappingInterval(9, 5)) == 0);
+    QVERIFY(a.compare(NonOverlappingInterval(-5, 5)) > 0);
+    QVERIFY(Three_Way_Compare<NonOverlappingInterval>::compare(a, NonOverlappingInterval(-4, 5)) == 0);
+    QVERIFY(Three_Way_Compare<int>::compare(1, 2) < 0);
+    QVERIFY(Three_Way_Compare<int>::compare(2, 2) == 0);
+    QVERIFY(Three_Way_Compare<Labelled_Range>::compare(Labelled_Range(5, 9), Labelled_Range(0, 4)) > 0);
+}
+
+void AVL_Tree_Test::customCompareOrdersTheTree()
+{
+    AVL_Tree<NonOverlappingInterval, allocator<NonOverlappingInterval>, No_Augment<NonOverlappingInterval>, No_Stats, Descending_Compare> rtree;
+    std::vector<int> keys = shuffledKeys(500);
+    for(unsigned i = 0; i < keys.size(); i++)
+        QVERIFY(rtree.insert(NonOverlappingInterval(keys[i], 5)));
+    QVERIFY(!rtree.insert(NonOverlappingInterval(12, 5)));
+    QVERIFY(rtree.begin()->sameAs(NonOverlappingInterval(4990, 5)));
+    QVERIFY(rtree.rank(NonOverlappingInterval(4980, 1)) == 1);
+    QVERIFY(rtree.find(NonOverlappingInterval(2002, 1))->sameAs(NonOverlappingInterval(2000, 5)));
+    QVERIFY(rtree.remove(NonOverlappingInterval(4990, 1)));
+    QVERIFY(rtree.begin()->sameAs(NonOverlappingInterval(4980, 5)));
+    QVERIFY(rtree.size() == 499);
+}
+
+void AVL_Tree_Test::saveAndLoadRoundTrip()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    const std::vector<int> keys = shuffledKeys(5000);
+    for(unsigned i = 0; i < keys.size(); i++)
+        rtree.insert(NonOverlappingInterval(keys[i], 5));
+    stringstream stream;
+    QVERIFY(rtree.save(stream));
+
+    AVL_Tree<NonOverlappingInterval> loaded;
+    loaded.insert(NonOverlappingInterval(-100, 5));
+    QVERIFY(loaded.load(stream));
+    QVERIFY(loaded.size() == 5000);
+    QVERIFY(loaded.find(NonOverlappingInterval(-100, 1)) == loaded.end());
+    unsigned i = 0;
+    for(AVL_Tree<NonOverlappingInterval>::const_iterator it = loaded.begin(); it != loaded.end(); ++it, ++i)
+        QVERIFY(it->sameAs(NonOverlappingInterval(i*10, 5)));
+    QVERIFY(loaded.insert(NonOverlappingInterval(50001, 5)));
+
+    const char * path = "tst_avltree_snapshot.bin";
+    AVL_Tree<NonOverlappingInterval> empty;
+    QVERIFY(empty.save(path));
+    QVERIFY(loaded.load(path));
+    QVERIFY(loaded.empty());
+    QVERIFY(rtree.save(path));
+    QVERIFY(loaded.load(path));
+    QVERIFY(loaded.select(4999)->sameAs(NonOverlappingInterval(49990, 5)));
+    std::remove(path);
+    QVERIFY(!loaded.load(path));
+    QVERIFY(loaded.size() == 5000);
+}
+
+void AVL_Tree_Test::loadRejectsDamagedSnapshots()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < 100; i++)
+        rtree.insert(NonOverlappingInterval(i*10, 5));
+    stringstream stream;
+    QVERIFY(rtree.save(stream));
+    const string saved = stream.str();
+
+    AVL_Tree<NonOverlappingInterval> loaded;
+    loaded.insert(NonOverlappingInterval(7, 1));
+    string damaged = saved;
+    damaged[0] = 'X';
+    stringstream bad_magic(damaged);
+    QVERIFY(!loaded.load(bad_magic));
+    damaged = saved;
+    damaged[30] ^= 1;
+    stringstream bad_payload(damaged);
+    QVERIFY(!loaded.load(bad_payload));
+    stringstream truncated(saved.substr(0, saved.size() - 1));
+    QVERIFY(!loaded.load(truncated));
+    QVERIFY(loaded.size() == 1);
+    QVERIFY(loaded.find(NonOverlappingInterval(7, 1)) != loaded.end());
+
+    AVL_Tree<NonOverlappingInterval, allocator<NonOverlappingInterval>, No_Augment<NonOverlappingInterval>, No_Stats, Descending_Compare> reversed;
+    stringstream ascending(saved);
+    QVERIFY(!reversed.load(ascending));
+}
+
+void AVL_Tree_Test::moveOnlyElementsAreNeverCopied()
+{
+    AVL_Tree<Labelled_Range> rtree;
+    QVERIFY(rtree.root() == NULL);
+    QVERIFY(rtree.emplace(0, 9, "boot"));
+    QVERIFY(rtree.insert(Labelled_Range(20, 29, "heap")));
+    QVERIFY(!rtree.emplace(5, 24, "overlaps both"));
+    QVERIFY(rtree.size() == 2);
+    QVERIFY(rtree.find(Labelled_Range(25, 25))->_label == "heap");
+    QVERIFY(rtree.find(Labelled_Range(15, 15)) == rtree.end());
+
+    Labelled_Range removed(0, 0);
+    QVERIFY(rtree.extract(Labelled_Range(3, 3), removed));
+    QVERIFY(removed._begin == 0 && removed._label == "boot");
+    QVERIFY(!rtree.extract(Labelled_Range(3, 3), removed));
+    QVERIFY(rtree.remove(Labelled_Range(20, 20)));
+    QVERIFY(rtree.empty());
+
+    Compact_AVL_Tree<Labelled_Range> compact;
+    for(int i = 0; i < 100; i++)
+        QVERIFY(compact.emplace(i*10, i*10 + 4, string(20, char('a' + i % 26))));
+    QVERIFY(compact.find(Labelled_Range(993, 993))->_label == string(20, 'v'));
+    QVERIFY(compact.extract(Labelled_Range(502, 502), removed));
+    QVERIFY(removed._begin == 500 && removed._label == string(20, 'y'));
+    QVERIFY(compact.find(Labelled_Range(502, 502)) == NULL);
+    QVERIFY(compact.size() == 99);
+
+    Lazy_AVL_Tree<Labelled_Range> lazy(1.0);
+    QVERIFY(lazy.insert(Labelled_Range(0, 9, "boot")));
+    QVERIFY(lazy.insert(Labelled_Range(20, 29, "heap")));
+    QVERIFY(lazy.remove(Labelled_Range(5, 5)));
+    QVERIFY(lazy.insert(Labelled_Range(0, 14, "kernel")));
+    QVERIFY(lazy.dead() == 0 && lazy.size() == 2);
+    QVERIFY(lazy.find(Labelled_Range(12, 12))->_label == "kernel");
+    QVERIFY(!lazy.insert(Labelled_Range(10, 25, "overlaps both")));
+    QVERIFY(lazy.check(Labelled_Range(25, 25)));
+}
+void AVL_Tree_Test::allocateFirstFitFillsTheLowestGap()
+{
+    Free_Gap_AVL_Tree space(0, 999);
+    QVERIFY(space.allocate_first_fit(100).sameAs(NonOverlappingInterval(0, 100)));
+    QVERIFY(space.allocate_first_fit(100).sameAs(NonOverlappingInterval(100, 100)));
+    QVERIFY(space.insert(NonOverlappingInterval(300, 100)));
+    QVERIFY(space.allocate_first_fit(50).sameAs(NonOverlappingInterval(200, 50)));
+    QVERIFY(space.allocate_first_fit(60).sameAs(NonOverlappingInterval(400, 60)));
+    QVERIFY(space.allocate_first_fit(50).sameAs(NonOverlappingInterval(250, 50)));
+    QVERIFY(space.size() == 6);
+}
+
+void AVL_Tree_Test::allocateBestFitPicksTheSmallestGap()
+{
+    Free_Gap_AVL_Tree space(0, 999);
+    QVERIFY(space.insert(NonOverlappingInterval(100, 100)));
+    QVERIFY(space.insert(NonOverlappingInterval(230, 100)));
+    QVERIFY(space.insert(NonOverlappingInterval(340, 600)));
+    QVERIFY(space.allocate_best_fit(10).sameAs(NonOverlappingInterval(330, 10)));
+    QVERIFY(space.allocate_best_fit(10).sameAs(NonOverlappingInterval(200, 10)));
+    QVERIFY(space.allocate_best_fit(60).sameAs(NonOverlappingInterval(940, 60)));
+    QVERIFY(space.allocate_best_fit(100).sameAs(NonOverlappingInterval(0, 100)));
+}
+
+void AVL_Tree_Test::allocateAtOrAfterAnAddress()
+{
+    Free_Gap_AVL_Tree space(0, 999);
+    QVERIFY(space.insert(NonOverlappingInterval(500, 100)));
+    QVERIFY(space.allocate_at_or_after(450, 50).sameAs(NonOverlappingInterval(450, 50)));
+    QVERIFY(space.allocate_at_or_after(420, 50).sameAs(NonOverlappingInterval(600, 50)));
+    QVERIFY(space.allocate_at_or_after(550, 10).sameAs(NonOverlappingInterval(650, 10)));
+    QVERIFY(space.allocate_at_or_after(-100, 10).sameAs(NonOverlappingInterval(0, 10)));
+}
+
+void AVL_Tree_Test::allocateFailsWhenNoGapIsLargeEnough()
+{
+    Free_Gap_AVL_Tree space(0, 99);
+    for(unsigned i = 0; i < 10; i++)
+        QVERIFY(space.insert(NonOverlappingInterval(i*10, 5)));
+    QVERIFY(space.largest_gap() == 5);
+    QVERIFY(space.allocate_first_fit(6).sameAs(NonOverlappingInterval::invalid()));
+    QVERIFY(space.allocate_best_fit(6).sameAs(NonOverlappingInterval::invalid()));
+    QVERIFY(space.allocate_at_or_after(0, 6).sameAs(NonOverlappingInterval::invalid()));
+    QVERIFY(!space.insert(NonOverlappingInterval(98, 5)));
+    QVERIFY(space.size() == 10);
 }
 
+void AVL_Tree_Test::removingAnAllocationMergesItsGaps()
+{
+    Free_Gap_AVL_Tree space(0, 99);
+    for(unsigned i = 0; i < 10; i++)
+        QVERIFY(space.allocate_first_fit(10).sameAs(NonOverlappingInterval(i*10, 10)));
+    QVERIFY(space.largest_gap() == 0);
+    QVERIFY(space.remove(NonOverlappingInterval(45, 1)));
+    QVERIFY(space.remove(NonOverlappingInterval(55, 1)));
+    QVERIFY(space.largest_gap() == 20);
+    QVERIFY(space.allocate_first_fit(15).sameAs(NonOverlappingInterval(40, 15)));
+    QVERIFY(space.largest_gap() == 5);
+}
+
+void AVL_Tree_Test::intervalSetMergesAdjacentAndOverlappingRanges()
+{
+    Interval_Set set;
+    QVERIFY(set.insert(NonOverlappingInterval(0, 10)));
+    QVERIFY(set.insert(NonOverlappingInterval(20, 10)));
+    QVERIFY(set.insert(NonOverlappingInterval(40, 10)));
+    QVERIFY(set.size() == 3);
+    QVERIFY(set.insert(NonOverlappingInterval(10, 10)));
+    QVERIFY(set.size() == 2);
+    QVERIFY(set.begin()->sameAs(NonOverlappingInterval(0, 30)));
+    QVERIFY(!set.insert(NonOverlappingInterval(5, 20)));
+    QVERIFY(set.insert(NonOverlappingInterval(25, 30)));
+    QVERIFY(set.size() == 1);
+    QVERIFY(set.begin()->sameAs(NonOverlappingInterval(0, 55)));
+    QVERIFY(set.insert(NonOverlappingInterval(numeric_limits<int>::max() - 9, 10)));
+    QVERIFY(set.insert(NonOverlappingInterval(numeric_limits<int>::max() - 19, 10)));
+    QVERIFY(set.size() == 2);
+    QVERIFY(set.contains(numeric_limits<int>::max()) && set.contains(54) && !set.contains(55));
+}
+
+void AVL_Tree_Test::intervalSetEraseSplitsPartiallyCoveredRanges()
+{
+    Interval_Set set;
+    QVERIFY(set.insert(NonOverlappingInterval(0, 100)));
+    QVERIFY(set.erase(NonOverlappingInterval(40, 20)));
+    QVERIFY(set.size() == 2);
+    QVERIFY(set.begin()->sameAs(NonOverlappingInterval(0, 40)));
+    QVERIFY((--set.end())->sameAs(NonOverlappingInterval(60, 40)));
+    QVERIFY(!set.erase(NonOverlappingInterval(45, 10)));
+    QVERIFY(set.insert(NonOverlappingInterval(200, 10)));
+    QVERIFY(set.erase(NonOverlappingInterval(30, 175)));
+    QVERIFY(set.size() == 2);
+    QVERIFY(set.begin()->sameAs(NonOverlappingInterval(0, 30)));
+    QVERIFY((--set.end())->sameAs(NonOverlappingInterval(205, 5)));
+    QVERIFY(set.erase(NonOverlappingInterval(-10, 300)));
+    QVERIFY(set.empty());
+
+    Interval_Set random;
+    std::vector<char> covered(1000, 0);
+    std::srand(19);
+    for(int i = 0; i < 2000; i++)
+    {
+        int begin = std::rand() % 990;
+        unsigned size = 1 + std::rand() % 10;
+        bool add = std::rand() % 3 != 0;
+        if(add)
+            random.insert(NonOverlappingInterval(begin, size));
+        else
+            random.erase(NonOverlappingInterval(begin, size));
+        for(unsigned j = 0; j < size; j++)
+            covered[begin + j] = add;
+    }
+    int last_end = -2;
+    for(Interval_Set::const_iterator it = random.begin(); it != random.end(); ++it)
+    {
+        QVERIFY(it->begin() > last_end + 1);
+        last_end = it->end();
+    }
+    for(int address = 0; address < 1000; address++)
+        QVERIFY(random.contains(address) == (covered[address] != 0));
+}
+void AVL_Tree_Test::intervalTreeHoldsOverlappingRanges()
+{
+    Interval_Tree tree;
+    QVERIFY(tree.any_overlap(NonOverlappingInterval(0, 100)) == tree.end());
+    QVERIFY(tree.insert(NonOverlappingInterval(0, 100)));
+    QVERIFY(tree.insert(NonOverlappingInterval(10, 5)));
+    QVERIFY(tree.insert(NonOverlappingInterval(10, 50)));
+    QVERIFY(tree.insert(NonOverlappingInterval(200, 10)));
+    QVERIFY(!tree.insert(NonOverlappingInterval(10, 5)));
+    QVERIFY(tree.size() == 4);
+
+    std::vector<NonOverlappingInterval> found;
+    QVERIFY(tree.overlaps(NonOverlappingInterval(12, 1), std::back_inserter(found)) == 3);
+    QVERIFY(found.size() == 3);
+    QVERIFY(found[0].sameAs(NonOverlappingInterval(0, 100)));
+    QVERIFY(found[1].sameAs(NonOverlappingInterval(10, 5)));
+    QVERIFY(found[2].sameAs(NonOverlappingInterval(10, 50)));
+    found.clear();
+    QVERIFY(tree.overlaps(NonOverlappingInterval(99, 102), std::back_inserter(found)) == 2);
+    QVERIFY(found[0].sameAs(NonOverlappingInterval(0, 100)) && found[1].sameAs(NonOverlappingInterval(200, 10)));
+    QVERIFY(tree.overlaps(NonOverlappingInterval(100, 100), std::back_inserter(found)) == 0);
+    QVERIFY(tree.any_overlap(NonOverlappingInterval(100, 100)) == tree.end());
+    QVERIFY(tree.any_overlap(NonOverlappingInterval(209, 1))->sameAs(NonOverlappingInterval(200, 10)));
+
+    QVERIFY(tree.remove(NonOverlappingInterval(0, 100)));
+    QVERIFY(!tree.remove(NonOverlappingInterval(0, 100)));
+    QVERIFY(tree.any_overlap(NonOverlappingInterval(80, 10)) == tree.end());
+    QVERIFY(tree.any_overlap(NonOverlappingInterval(50, 10))->sameAs(NonOverlappingInterval(10, 50)));
+}
+
+// Random inserts and removes rotate the tree many times; every query must
+// still see what a scan of all the ranges sees.
+void AVL_Tree_Test::intervalTreeMatchesAScanAfterRotations()
+{
+    Interval_Tree tree;
+    std::vector<NonOverlappingInterval> stored;
+    std::srand(25);
+    for(int i = 0; i < 3000; i++)
+    {
+        NonOverlappingInterval range(std::rand() % 2000, 1 + std::rand() % (std::rand() % 4 == 0 ? 400 : 20));
+        if(std::rand() % 4 != 0)
+        {
+            bool known = false;
+            for(unsigned j = 0; j < stored.size() && !known; j++)
+                known = stored[j].sameAs(range);
+            QVERIFY(tree.insert(range) == !known);
+            if(!known)
+                stored.push_back(range);
+        }
+        else if(!stored.empty())
+        {
+            unsigned victim = std::rand() % stored.size();
+            QVERIFY(tree.remove(stored[victim]));
+            stored.erase(stored.begin() + victim);
+        }
+    }
+    QVERIFY(tree.size() == stored.size());
+    for(int i = 0; i < 500; i++)
+    {
+        NonOverlappingInterval query(std::rand() % 2200 - 100, 1 + std::rand() % 50);
+        unsigned expected = 0;
+        for(unsigned j = 0; j < stored.size(); j++)
+            expected += stored[j].begin() <= query.end() && stored[j].end() >= query.begin();
+        std::vector<NonOverlappingInterval> found;
+        QVERIFY(tree.overlaps(query, std::back_inserter(found)) == expected);
+        QVERIFY(found.size() == expected);
+        for(unsigned j = 0; j < found.size(); j++)
+        {
+            QVERIFY(found[j].begin() <= query.end() && found[j].end() >= query.begin());
+            QVERIFY(j == 0 || Begin_End_Compare::compare(found[j - 1], found[j]) < 0);
+        }
+        Interval_Tree::const_iterator any = tree.any_overlap(query);
+        QVERIFY((any == tree.end()) == (expected == 0));
+        QVERIFY(any == tree.end() || (any->begin() <= query.end() && any->end() >= query.begin()));
+    }
+}
+
+void AVL_Tree_Test::selectTheKthSmallestElement()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    const std::vector<int> keys = shuffledKeys(1000);
+    for(unsigned i = 0; i < keys.size(); i++)
+        QVERIFY(rtree.insert(NonOverlappingInterval(keys[i], 5)));
+    QVERIFY(rtree.select(0)->sameAs(NonOverlappingInterval(0, 5)));
+    QVERIFY(rtree.select(989)->sameAs(NonOverlappingInterval(9890, 5)));
+    QVERIFY(rtree.select(999)->sameAs(NonOverlappingInterval(9990, 5)));
+    QVERIFY(rtree.select(1000) == rtree.end());
+}
+
+void AVL_Tree_Test::rankCountsSmallerElements()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    QVERIFY(rtree.rank(NonOverlappingInterval(10, 1)) == 0);
+    for(unsigned i = 0; i < 100; i++)
+        QVERIFY(rtree.insert(NonOverlappingInterval(i*10, 5)));
+    QVERIFY(rtree.rank(NonOverlappingInterval(0, 1)) == 0);
+    QVERIFY(rtree.rank(NonOverlappingInterval(502, 1)) == 50);
+    QVERIFY(rtree.rank(NonOverlappingInterval(507, 1)) == 51);
+    QVERIFY(rtree.rank(NonOverlappingInterval(5000, 1)) == 100);
+}
+
+void AVL_Tree_Test::countInRangeAfterInsertsAndRemoves()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < 100; i++)
+        QVERIFY(rtree.insert(NonOverlappingInterval(i*10, 5)));
+    for(unsigned i = 0; i < 100; i += 2)
+        rtree.remove(NonOverlappingInterval(i*10, 1));
+    QVERIFY(rtree.count_in_range(NonOverlappingInterval(0, 1), NonOverlappingInterval(999, 1)) == 50);
+    QVERIFY(rtree.count_in_range(NonOverlappingInterval(100, 1), NonOverlappingInterval(199, 1)) == 5);
+    QVERIFY(rtree.count_in_range(NonOverlappingInterval(106, 1), NonOverlappingInterval(108, 1)) == 0);
+    QVERIFY(rtree.count_in_range(NonOverlappingInterval(300, 1), NonOverlappingInterval(100, 1)) == 0);
+}
+void AVL_Tree_Test::insertBatchReportsPerElementSuccess()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    QVERIFY(rtree.insert(NonOverlappingInterval(100, 10)));
+    QVERIFY(rtree.insert(NonOverlappingInterval(300, 10)));
+    std::vector<NonOverlappingInterval> batch;
+    batch.push_back(NonOverlappingInterval(0, 10));
+    batch.push_back(NonOverlappingInterval(105, 10));
+    batch.push_back(NonOverlappingInterval(200, 10));
+    batch.push_back(NonOverlappingInterval(205, 10));
+    batch.push_back(NonOverlappingInterval(400, 10));
+    std::vector<bool> inserted;
+    QVERIFY(rtree.insert_batch(batch.begin(), batch.end(), std::back_inserter(inserted)) == 3);
+    QVERIFY(inserted.size() == 5);
+    QVERIFY(inserted[0] && !inserted[1] && inserted[2] && !inserted[3] && inserted[4]);
+    QVERIFY(rtree.size() == 5);
+    QVERIFY(rtree.find(NonOverlappingInterval(205, 1))->sameAs(NonOverlappingInterval(200, 10)));
+    QVERIFY(rtree.find(NonOverlappingInterval(405, 1))->sameAs(NonOverlappingInterval(400, 10)));
+}
+
+void AVL_Tree_Test::removeBatchReportsPerElementSuccess()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < 100; i++)
+        QVERIFY(rtree.insert(NonOverlappingInterval(i*10, 5)));
+    std::vector<NonOverlappingInterval> batch;
+    batch.push_back(NonOverlappingInterval(11, 1));
+    batch.push_back(NonOverlappingInterval(17, 1));
+    batch.push_back(NonOverlappingInterval(500, 1));
+    batch.push_back(NonOverlappingInterval(2000, 1));
+    std::vector<bool> removed;
+    QVERIFY(rtree.remove_batch(batch.begin(), batch.end(), std::back_inserter(removed)) == 2);
+    QVERIFY(removed[0] && !removed[1] && removed[2] && !removed[3]);
+    QVERIFY(rtree.size() == 98);
+    QVERIFY(!rtree.check(NonOverlappingInterval(10, 1)));
+    QVERIFY(!rtree.check(NonOverlappingInterval(500, 1)));
+    QVERIFY(rtree.check(NonOverlappingInterval(20, 1)));
+
+    // Queries reaching over two stored ranges: the first match goes to the
+    // first query, and the next query takes the range after it.
+    AVL_Tree<NonOverlappingInterval> pair;
+    QVERIFY(pair.insert(NonOverlappingInterval(1, 10)));
+    QVERIFY(pair.insert(NonOverlappingInterval(11, 10)));
+    batch.clear();
+    batch.push_back(NonOverlappingInterval(5, 2));
+    batch.push_back(NonOverlappingInterval(9, 4));
+    removed.clear();
+    QVERIFY(pair.remove_batch(batch.begin(), batch.end(), std::back_inserter(removed)) == 2);
+    QVERIFY(removed[0] && removed[1]);
+    QVERIFY(pair.empty());
+
+    AVL_Tree<NonOverlappingInterval> looped;
+    AVL_Tree<NonOverlappingInterval> batched;
+    for(unsigned i = 0; i < 100; i++)
+    {
+        QVERIFY(looped.insert(NonOverlappingInterval(i*10, 10)));
+        QVERIFY(batched.insert(NonOverlappingInterval(i*10, 10)));
+    }
+    batch.clear();
+    for(int address = 5; address < 1000; address += 7)
+        batch.push_back(NonOverlappingInterval(address, 3));
+    removed.clear();
+    batched.remove_batch(batch.begin(), batch.end(), std::back_inserter(removed));
+    for(unsigned i = 0; i < batch.size(); i++)
+        QVERIFY(looped.remove(batch[i]) == removed[i]);
+    QVERIFY(looped.size() == batched.size());
+    for(AVL_Tree<NonOverlappingInterval>::const_iterator a = looped.begin(), b = batched.begin(); a != looped.end(); ++a, ++b)
+        QVERIFY(a->sameAs(*b));
+}
+
+void AVL_Tree_Test::insertBatchKeepsTheTreeBalanced()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    std::vector<NonOverlappingInterval> batch;
+    for(unsigned i = 0; i < 1000; i++)
+        batch.push_back(NonOverlappingInterval(i*20, 5));
+    std::vector<bool> inserted;
+    QVERIFY(rtree.insert_batch(batch.begin(), batch.end(), std::back_inserter(inserted)) == 1000);
+    batch.clear();
+    for(unsigned i = 0; i < 1000; i++)
+        batch.push_back(NonOverlappingInterval(i*20 + 10, 5));
+    QVERIFY(rtree.insert_batch(batch.begin(), batch.end(), std::back_inserter(inserted)) == 1000);
+    QVERIFY(rtree.size() == 2000);
+    QVERIFY(rtree.select(1000)->sameAs(NonOverlappingInterval(10000, 5)));
+    int previous = -1;
+    for(AVL_Tree<NonOverlappingInterval>::const_iterator it = rtree.begin(); it != rtree.end(); ++it)
+    {
+        QVERIFY(it->begin() > previous);
+        previous = it->begin();
+    }
+    for(unsigned i = 0; i < 2000; i += 2)
+        QVERIFY(extracts(rtree, NonOverlappingInterval(i*10, 1), NonOverlappingInterval(i*10, 5)));
+    QVERIFY(rtree.size() == 1000);
+}
+
+void AVL_Tree_Test::hintedInsertStartsFromTheHint()
+{
+    typedef AVL_Tree<NonOverlappingInterval, allocator<NonOverlappingInterval>, No_Augment<NonOverlappingInterval>, Thread_Stats> Counted_Tree;
+    Counted_Tree rtree;
+    Counted_Tree::const_iterator finger = rtree.end();
+    Thread_Stats::reset();
+    for(int i = 0; i < 1000; i++)
+        finger = rtree.insert(finger, NonOverlappingInterval(i*10, 5));
+    QVERIFY(Thread_Stats::local()._compares <= 1000);
+    QVERIFY(rtree.size() == 1000);
+    QVERIFY(rtree.insert(rtree.begin(), NonOverlappingInterval(-10, 5))->begin() == -10);
+    QVERIFY(rtree.insert(rtree.find(NonOverlappingInterval(5000, 1)), NonOverlappingInterval(5005, 5))->begin() == 5005);
+    QVERIFY(rtree.insert(rtree.begin(), NonOverlappingInterval(9001, 2))->sameAs(NonOverlappingInterval(9000, 5)));
+    QVERIFY(rtree.insert(rtree.end(), NonOverlappingInterval(3, 2))->sameAs(NonOverlappingInterval(0, 5)));
+    QVERIFY(rtree.size() == 1002);
+    Counted_Tree::const_iterator stored = rtree.insert(rtree.end(), NonOverlappingInterval(7002, 1));
+    QVERIFY(stored->sameAs(NonOverlappingInterval(7000, 5)));
+    QVERIFY(rtree.insert(stored, NonOverlappingInterval(7006, 2))->begin() == 7006);
+    Thread_Stats::reset();
+    rtree.insert(rtree.end(), NonOverlappingInterval(20000, 5));
+    QVERIFY(Thread_Stats::local()._descents[INSERT_OPERATION] == 1);
+    QVERIFY(rtree.rank(NonOverlappingInterval(5005, 1)) == 502);
+    int previous = -20;
+    for(Counted_Tree::const_iterator it = rtree.begin(); it != rtree.end(); ++it)
+    {
+        QVERIFY(it->begin() > previous);
+        previous = it->begin();
+    }
+}
+
+void AVL_Tree_Test::lazyTreeSkipsRemovedElements()
+{
+    Lazy_AVL_Tree<NonOverlappingInterval> rtree(1.0);
+    for(int i = 0; i < 100; i++)
+        QVERIFY(rtree.insert(NonOverlappingInterval(i*10, 5)));
+    for(int i = 0; i < 100; i += 2)
+        QVERIFY(rtree.remove(NonOverlappingInterval(i*10 + 1, 1)));
+    QVERIFY(!rtree.remove(NonOverlappingInterval(20, 5)));
+    QVERIFY(rtree.size() == 50 && rtree.dead() == 50);
+    QVERIFY(rtree.find(NonOverlappingInterval(40, 1)) == NULL);
+    QVERIFY(rtree.find(NonOverlappingInterval(52, 1))->begin() == 50);
+    QVERIFY(rtree.find(NonOverlappingInterval(0, 30))->begin() == 10);
+    int expected = 10;
+    for(Lazy_AVL_Tree<NonOverlappingInterval>::const_iterator it = rtree.begin(); it != rtree.end(); ++it, expected += 20)
+        QVERIFY(it->begin() == expected);
+    QVERIFY(expected == 1010);
+    QVERIFY(!rtree.insert(NonOverlappingInterval(12, 10)));
+    QVERIFY(!rtree.insert(NonOverlappingInterval(39, 12)));
+    QVERIFY(rtree.insert(NonOverlappingInterval(15, 10)));
+    QVERIFY(rtree.size() == 51 && rtree.dead() == 49);
+}
+
+void AVL_Tree_Test::lazyTreeCompactsPastItsThreshold()
+{
+    Lazy_AVL_Tree<NonOverlappingInterval> rtree(0.5);
+    for(int i = 0; i < 1000; i++)
+        QVERIFY(rtree.insert(NonOverlappingInterval(i*10, 5)));
+    for(int i = 0; i < 500; i++)
+        QVERIFY(rtree.remove(NonOverlappingInterval(i*10, 1)));
+    QVERIFY(rtree.dead() == 500);
+    QVERIFY(rtree.remove(NonOverlappingInterval(9990, 1)));
+    QVERIFY(rtree.dead() == 0 && rtree.size() == 499);
+    QVERIFY(rtree.find(NonOverlappingInterval(5000, 1))->begin() == 5000);
+    QVERIFY(rtree.remove(NonOverlappingInterval(5000, 1)));
+    rtree.compact();
+    QVERIFY(rtree.dead() == 0 && rtree.size() == 498);
+    QVERIFY(rtree.begin()->begin() == 5010);
+}
+
+void AVL_Tree_Test::snapshotDoesNotSeeLaterWrites()
+{
+    Snapshot_AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < 100; i++)
+        QVERIFY(rtree.insert(NonOverlappingInterval(i*10, 5)));
+    QVERIFY(!rtree.insert(NonOverlappingInterval(12, 5)));
+    Snapshot_AVL_Tree<NonOverlappingInterval>::Snapshot before = rtree.snapshot();
+    for(unsigned i = 0; i < 100; i += 2)
+        QVERIFY(extracts(rtree, NonOverlappingInterval(i*10, 1), NonOverlappingInterval(i*10, 5)));
+    QVERIFY(rtree.insert(NonOverlappingInterval(2000, 5)));
+    QVERIFY(rtree.size() == 51);
+    QVERIFY(before.find(NonOverlappingInterval(0, 1))->sameAs(NonOverlappingInterval(0, 5)));
+    QVERIFY(before.find(NonOverlappingInterval(2000, 1)) == NULL);
+    QVERIFY(rtree.snapshot().find(NonOverlappingInterval(0, 1)) == NULL);
+    QVERIFY(rtree.snapshot().find(NonOverlappingInterval(2000, 1))->sameAs(NonOverlappingInterval(2000, 5)));
+    unsigned visited = 0;
+    before.for_each_in_range(NonOverlappingInterval(100, 1), NonOverlappingInterval(199, 1),
+                             [&visited](const NonOverlappingInterval &) { visited++; });
+    QVERIFY(visited == 10);
+}
+
+void AVL_Tree_Test::snapshotReadersRunAlongsideAWriter()
+{
+    Snapshot_AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < 1000; i++)
+        QVERIFY(rtree.insert(NonOverlappingInterval(i*10, 5)));
+    std::atomic<bool> done(false);
+    std::atomic<unsigned> inconsistent(0);
+    std::vector<std::thread> readers;
+    for(unsigned r = 0; r < 4; r++)
+        readers.push_back(std::thread([&rtree, &done, &inconsistent]() {
+            while(!done.load())
+            {
+                Snapshot_AVL_Tree<NonOverlappingInterval>::Snapshot snapshot = rtree.snapshot();
+                // Even keys are never touched by the writer.
+                for(unsigned i = 0; i < 1000; i += 2)
+                {
+                    const NonOverlappingInterval * found = snapshot.find(NonOverlappingInterval(i*10, 1));
+                    if(found == NULL || !found->sameAs(NonOverlappingInterval(i*10, 5)))
+                        inconsistent++;
+                }
+            }
+        }));
+    for(unsigned round = 0; round < 20; round++)
+        for(unsigned i = 1; i < 1000; i += 2)
+        {
+            if(round % 2 == 0)
+                rtree.remove(NonOverlappingInterval(i*10, 1));
+            else
+                rtree.insert(NonOverlappingInterval(i*10, 5));
+        }
+    done.store(true);
+    for(unsigned r = 0; r < readers.size(); r++)
+        readers[r].join();
+    QVERIFY(inconsistent.load() == 0);
+    QVERIFY(rtree.size() == 1000);
+}
+
+void AVL_Tree_Test::shardedTreeHandlesRangesAcrossShards()
+{
+    Sharded_AVL_Tree<NonOverlappingInterval> rtree(0, 999, 10);
+    QVERIFY(rtree.shards() == 10);
+    QVERIFY(rtree.insert(NonOverlappingInterval(90, 30)));
+    QVERIFY(rtree.insert(NonOverlappingInterval(250, 500)));
+    QVERIFY(!rtree.insert(NonOverlappingInterval(80, 11)));
+    QVERIFY(!rtree.insert(NonOverlappingInterval(600, 1)));
+    QVERIFY(rtree.insert(NonOverlappingInterval(120, 5)));
+    QVERIFY(rtree.insert(NonOverlappingInterval(-50, 10)));
+    QVERIFY(rtree.insert(NonOverlappingInterval(990, 100)));
+    QVERIFY(rtree.size() == 5);
+    QVERIFY(finds(rtree, NonOverlappingInterval(110, 1), NonOverlappingInterval(90, 30)));
+    QVERIFY(finds(rtree, NonOverlappingInterval(1050, 1), NonOverlappingInterval(990, 100)));
+    QVERIFY(extracts(rtree, NonOverlappingInterval(700, 1), NonOverlappingInterval(250, 500)));
+    QVERIFY(!rtree.check(NonOverlappingInterval(300, 1)));
+    QVERIFY(!rtree.check(NonOverlappingInterval(700, 1)));
+    QVERIFY(rtree.insert(NonOverlappingInterval(300, 400)));
+    QVERIFY(extracts(rtree, NonOverlappingInterval(1000, 1), NonOverlappingInterval(990, 100)));
+    QVERIFY(!rtree.remove(NonOverlappingInterval(1000, 1)));
+    QVERIFY(rtree.size() == 4);
+}
+
+// Each writer fills and empties its own region, with ranges crossing into
+// the neighbouring regions.
+static void writeRegion(Sharded_AVL_Tree<NonOverlappingInterval> & rtree, int region, unsigned count)
+{
+    for(unsigned i = 0; i < count; i++)
+        rtree.insert(NonOverlappingInterval(region + i*10, 5));
+    rtree.insert(NonOverlappingInterval(region - 3, 3));
+    for(unsigned i = 0; i < count; i++)
+        rtree.remove(NonOverlappingInterval(region + i*10, 1));
+}
+
+void AVL_Tree_Test::shardedTreeWritersOnDifferentRegions()
+{
+    Sharded_AVL_Tree<NonOverlappingInterval> rtree(0, 8*10000 - 1, 16);
+    std::vector<std::thread> writers;
+    for(unsigned w = 0; w < 8; w++)
+        writers.push_back(std::thread(writeRegion, std::ref(rtree), int(w*10000), 1000u));
+    for(unsigned w = 0; w < writers.size(); w++)
+        writers[w].join();
+    QVERIFY(rtree.size() == 8);
+    for(unsigned w = 0; w < 8; w++)
+        QVERIFY(finds(rtree, NonOverlappingInterval(w*10000 - 1, 1), NonOverlappingInterval(w*10000 - 3, 3)));
+}
+
+void AVL_Tree_Test::statsCountRotationsNodesAndDescents()
+{
+    typedef AVL_Tree<NonOverlappingInterval, allocator<NonOverlappingInterval>, No_Augment<NonOverlappingInterval>, Thread_Stats> Counted_Tree;
+    Thread_Stats::reset();
+    {
+        Counted_Tree rtree;
+        QVERIFY(rtree.insert(NonOverlappingInterval(0, 2)));
+        QVERIFY(rtree.insert(NonOverlappingInterval(10, 2)));
+        QVERIFY(rtree.insert(NonOverlappingInterval(20, 2)));
+        QVERIFY(Thread_Stats::local()._rotations[LL_ROTATION] == 1);
+        QVERIFY(rtree.insert(NonOverlappingInterval(5, 2)));
+        QVERIFY(rtree.insert(NonOverlappingInterval(3, 1)));
+        QVERIFY(Thread_Stats::local()._rotations[RL_ROTATION] == 1);
+        QVERIFY(!rtree.insert(NonOverlappingInterval(1, 1)));
+        QVERIFY(Thread_Stats::local().rotations() == 2);
+        QVERIFY(Thread_Stats::local()._allocated == 5);
+
+        Thread_Stats::local()._compares = 0;
+        QVERIFY(rtree.find(NonOverlappingInterval(5, 1))->sameAs(NonOverlappingInterval(5, 2)));
+        QVERIFY(Thread_Stats::local()._descents[FIND_OPERATION] == 1);
+        QVERIFY(Thread_Stats::local()._descent_depth[FIND_OPERATION] == 3);
+        QVERIFY(Thread_Stats::local()._compares == 3); // one per level
+        QVERIFY(extracts(rtree, NonOverlappingInterval(20, 1), NonOverlappingInterval(20, 2)));
+        QVERIFY(Thread_Stats::local()._freed == 1);
+    }
+    QVERIFY(Thread_Stats::local()._freed == 5);
+    QVERIFY(Thread_Stats::local()._descents[INSERT_OPERATION] == 6);
+    QVERIFY(Thread_Stats::local()._depth_histogram[3] >= 1);
+    Thread_Stats::reset();
+    QVERIFY(Thread_Stats::local()._allocated == 0);
+}
+
+void AVL_Tree_Test::splitAtAKey()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < 1000; i++)
+        QVERIFY(rtree.insert(NonOverlappingInterval(i*10, 5)));
+    AVL_Tree<NonOverlappingInterval> upper = rtree.split(NonOverlappingInterval(3002, 1));
+    QVERIFY(rtree.size() == 300);
+    QVERIFY(upper.size() == 700);
+    QVERIFY((--rtree.end())->sameAs(NonOverlappingInterval(2990, 5)));
+    QVERIFY(upper.begin()->sameAs(NonOverlappingInterval(3000, 5)));
+    QVERIFY(upper.select(699)->sameAs(NonOverlappingInterval(9990, 5)));
+    QVERIFY(rtree.find(NonOverlappingInterval(3000, 1)) == rtree.end());
+    unsigned count = 0;
+    for(AVL_Tree<NonOverlappingInterval>::const_iterator it = upper.begin(); it != upper.end(); ++it)
+        QVERIFY(it->begin() == int(3000 + 10*count++));
+    QVERIFY(count == 700);
+    AVL_Tree<NonOverlappingInterval> empty = rtree.split(NonOverlappingInterval(5000, 1));
+    QVERIFY(empty.empty());
+    QVERIFY(rtree.size() == 300);
+    QVERIFY(extracts(upper, NonOverlappingInterval(5000, 1), NonOverlappingInterval(5000, 5)));
+    QVERIFY(rtree.insert(NonOverlappingInterval(5000, 5)));
+}
+
+void AVL_Tree_Test::joinTreesBackTogether()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < 1000; i++)
+        QVERIFY(rtree.insert(NonOverlappingInterval(i*10, 5)));
+    AVL_Tree<NonOverlappingInterval> upper = rtree.split(NonOverlappingInterval(7000, 1));
+    QVERIFY(!upper.join(rtree));
+    QVERIFY(rtree.join(upper));
+    QVERIFY(upper.empty());
+    QVERIFY(rtree.size() == 1000);
+    for(unsigned i = 0; i < 1000; i++)
+        QVERIFY(rtree.select(i)->sameAs(NonOverlappingInterval(i*10, 5)));
+    QVERIFY(rtree.rank(NonOverlappingInterval(7000, 1)) == 700);
+}
+
+void AVL_Tree_Test::joinTreesFromDifferentPools()
+{
+    AVL_Tree<NonOverlappingInterval> low;
+    AVL_Tree<NonOverlappingInterval> high;
+    for(unsigned i = 0; i < 100; i++)
+    {
+        QVERIFY(low.insert(NonOverlappingInterval(i*10, 5)));
+        QVERIFY(high.insert(NonOverlappingInterval(1000 + i*10, 5)));
+    }
+    AVL_Tree<NonOverlappingInterval> highest = high.split(NonOverlappingInterval(1500, 1));
+    QVERIFY(low.join(high));
+    QVERIFY(low.size() == 150);
+    // highest still holds the pool high was using, now merged into low's.
+    QVERIFY(extracts(highest, NonOverlappingInterval(1500, 1), NonOverlappingInterval(1500, 5)));
+    QVERIFY(highest.insert(NonOverlappingInterval(1502, 3)));
+    QVERIFY(extracts(low, NonOverlappingInterval(1000, 1), NonOverlappingInterval(1000, 5)));
+    QVERIFY(low.join(highest));
+    QVERIFY(low.size() == 199);
+    QVERIFY((--low.end())->sameAs(NonOverlappingInterval(1990, 5)));
+    low.clear();
+    QVERIFY(low.insert(NonOverlappingInterval(0, 5)));
+}
+
+// The halves of a split share a node pool; each gets its own writer.
+void AVL_Tree_Test::splitHalvesChangeOnSeparateThreads()
+{
+    AVL_Tree<NonOverlappingInterval> low;
+    for(int i = 0; i < 20000; i++)
+        QVERIFY(low.insert(NonOverlappingInterval(i*10, 5)));
+    AVL_Tree<NonOverlappingInterval> high = low.split(NonOverlappingInterval(100000, 1));
+    bool failed[2] = { false, false };
+    std::vector<std::thread> writers;
+    for(int half = 0; half < 2; half++)
+    {
+        AVL_Tree<NonOverlappingInterval> * tree = half == 0 ? &low : &high;
+        bool * failure = &failed[half];
+        writers.push_back(std::thread([tree, half, failure]() {
+            for(int round = 0; round < 3; round++)
+                for(int i = half * 10000; i < (half + 1) * 10000; i += 2)
+                {
+                    if(!tree->remove(NonOverlappingInterval(i*10, 1)))
+                        *failure = true;
+                    if(!tree->insert(NonOverlappingInterval(i*10 + 1, 3)))
+                        *failure = true;
+                    if(!tree->remove(NonOverlappingInterval(i*10 + 1, 1)))
+                        *failure = true;
+                    if(!tree->insert(NonOverlappingInterval(i*10, 5)))
+                        *failure = true;
+                }
+        }));
+    }
+    for(unsigned i = 0; i < writers.size(); i++)
+        writers[i].join();
+    QVERIFY(!failed[0] && !failed[1]);
+    QVERIFY(low.size() == 10000 && high.size() == 10000);
+    QVERIFY(low.join(high));
+    int previous = -10;
+    for(AVL_Tree<NonOverlappingInterval>::const_iterator it = low.begin(); it != low.end(); ++it)
+    {
+        QVERIFY(it->begin() == previous + 10);
+        previous = it->begin();
+    }
+    QVERIFY(previous == 199990);
+}
+
+void AVL_Tree_Test::unionKeepsOwnElementsOnOverlap()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    AVL_Tree<NonOverlappingInterval> other;
+    QVERIFY(rtree.insert(NonOverlappingInterval(0, 10)));
+    QVERIFY(rtree.insert(NonOverlappingInterval(50, 10)));
+    QVERIFY(other.insert(NonOverlappingInterval(5, 10)));
+    QVERIFY(other.insert(NonOverlappingInterval(20, 10)));
+    QVERIFY(other.insert(NonOverlappingInterval(52, 2)));
+    QVERIFY(other.insert(NonOverlappingInterval(100, 10)));
+    rtree.union_with(other);
+    QVERIFY(other.empty());
+    QVERIFY(rtree.size() == 4);
+    QVERIFY(rtree.find(NonOverlappingInterval(5, 1))->sameAs(NonOverlappingInterval(0, 10)));
+    QVERIFY(rtree.find(NonOverlappingInterval(52, 1))->sameAs(NonOverlappingInterval(50, 10)));
+    QVERIFY(rtree.find(NonOverlappingInterval(25, 1))->sameAs(NonOverlappingInterval(20, 10)));
+    QVERIFY(rtree.find(NonOverlappingInterval(105, 1))->sameAs(NonOverlappingInterval(100, 10)));
+    QVERIFY(other.insert(NonOverlappingInterval(5, 10)));
+}
+
+void AVL_Tree_Test::intersectAndSubtractPartitionATree()
+{
+    AVL_Tree<NonOverlappingInterval> reserved;
+    for(unsigned i = 0; i < 100; i++)
+        QVERIFY(reserved.insert(NonOverlappingInterval(i*10, 5)));
+    AVL_Tree<NonOverlappingInterval> free_ranges;
+    QVERIFY(free_ranges.insert(NonOverlappingInterval(0, 100)));
+    QVERIFY(free_ranges.insert(NonOverlappingInterval(504, 2)));
+    QVERIFY(free_ranges.insert(NonOverlappingInterval(905, 5)));
+    AVL_Tree<NonOverlappingInterval> kept;
+    for(unsigned i = 0; i < 100; i++)
+        QVERIFY(kept.insert(NonOverlappingInterval(i*10, 5)));
+    kept.intersect_with(free_ranges);
+    reserved.subtract(free_ranges);
+    QVERIFY(kept.size() == 11);
+    QVERIFY(reserved.size() == 89);
+    QVERIFY(kept.check(NonOverlappingInterval(500, 1)));
+    QVERIFY(!reserved.check(NonOverlappingInterval(500, 1)));
+    QVERIFY(!kept.check(NonOverlappingInterval(900, 1)));
+    QVERIFY(reserved.check(NonOverlappingInterval(900, 1)));
+    QVERIFY(free_ranges.size() == 3);
+    kept.subtract(kept);
+    QVERIFY(kept.empty());
+}
+
+// Large enough for the set operations to fork.
+void AVL_Tree_Test::setOperationsOnLargeTrees()
+{
+    std::vector<NonOverlappingInterval> even;
+    std::vector<NonOverlappingInterval> thirds;
+    for(unsigned i = 0; i < 200000; i += 2)
+        even.push_back(NonOverlappingInterval(i*10, 5));
+    for(unsigned i = 0; i < 200000; i += 3)
+        thirds.push_back(NonOverlappingInterval(i*10 + 2, 1));
+    AVL_Tree<NonOverlappingInterval> a;
+    AVL_Tree<NonOverlappingInterval> b;
+    QVERIFY(a.assign(even.begin(), even.end()));
+    QVERIFY(b.assign(thirds.begin(), thirds.end()));
+    a.intersect_with(b);
+    QVERIFY(a.size() == 33334);
+    QVERIFY(a.select(1)->sameAs(NonOverlappingInterval(60, 5)));
+    QVERIFY(a.assign(even.begin(), even.end()));
+    a.subtract(b);
+    QVERIFY(a.size() == 100000 - 33334);
+    a.union_with(b);
+    QVERIFY(a.size() == 100000 - 33334 + 66667);
+    QVERIFY(a.rank(NonOverlappingInterval(60, 1)) == 4);
+}
+
+void AVL_Tree_Test::benchmarkInsert()
+{
+    const std::vector<int> keys = shuffledKeys(100000);
+    QBENCHMARK {
+        AVL_Tree<NonOverlappingInterval> rtree;
+        for(unsigned i = 0; i < keys.size(); i++)
+            rtree.insert(NonOverlappingInterval(keys[i], 5));
+    }
+}
+
+void AVL_Tree_Test::benchmarkInsertSortedWithHint()
+{
+    QBENCHMARK {
+        AVL_Tree<NonOverlappingInterval> rtree;
+        AVL_Tree<NonOverlappingInterval>::const_iterator finger = rtree.end();
+        for(int i = 0; i < 100000; i++)
+            finger = rtree.insert(finger, NonOverlappingInterval(i*10, 5));
+    }
+}
+
+// Rebuilds the tree benchmarkInsert builds from a saved snapshot.
+void AVL_Tree_Test::benchmarkLoad()
+{
+    const std::vector<int> keys = shuffledKeys(100000);
+    AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < keys.size(); i++)
+        rtree.insert(NonOverlappingInterval(keys[i], 5));
+    stringstream stream;
+    rtree.save(stream);
+    const string saved = stream.str();
+    QBENCHMARK {
+        stringstream in(saved);
+        AVL_Tree<NonOverlappingInterval> loaded;
+        loaded.load(in);
+    }
+}
+
+// Attaches to the same elements kept in a mapped file, and finds one.
+void AVL_Tree_Test::benchmarkAttachMapped()
+{
+    const char * path = "tst_avltree_mapped.avl";
+    std::remove(path);
+    const std::vector<int> keys = shuffledKeys(100000);
+    {
+        Compact_AVL_Tree<NonOverlappingInterval, Mapped_Storage> rtree(path);
+        for(unsigned i = 0; i < keys.size(); i++)
+            rtree.insert(NonOverlappingInterval(keys[i], 5));
+    }
+    QBENCHMARK {
+        Compact_AVL_Tree<NonOverlappingInterval, Mapped_Storage> rtree(path, true);
+        QVERIFY(rtree.find(NonOverlappingInterval(500002, 1)) != NULL);
+    }
+    std::remove(path);
+}
+
+void AVL_Tree_Test::benchmarkFind()
+{
+    const std::vector<int> keys = shuffledKeys(100000);
+    AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < keys.size(); i++)
+        rtree.insert(NonOverlappingInterval(keys[i], 5));
+    unsigned found = 0;
+    QBENCHMARK {
+        for(unsigned i = 0; i < keys.size(); i++)
+            found += rtree.find(NonOverlappingInterval(keys[i] + 1, 2)) != rtree.end();
+    }
+    QVERIFY(found % keys.size() == 0);
+}
+
+void AVL_Tree_Test::benchmarkFindWithStats()
+{
+    const std::vector<int> keys = shuffledKeys(100000);
+    AVL_Tree<NonOverlappingInterval, allocator<NonOverlappingInterval>, No_Augment<NonOverlappingInterval>, Thread_Stats> rtree;
+    for(unsigned i = 0; i < keys.size(); i++)
+        rtree.insert(NonOverlappingInterval(keys[i], 5));
+    unsigned found = 0;
+    QBENCHMARK {
+        for(unsigned i = 0; i < keys.size(); i++)
+            found += rtree.find(NonOverlappingInterval(keys[i] + 1, 2)) != rtree.end();
+    }
+    QVERIFY(found % keys.size() == 0);
+}
+
+// Nine lookups in ten go to 64 hot ranges.
+void AVL_Tree_Test::benchmarkFindHotWithCache()
+{
+    const std::vector<int> keys = shuffledKeys(100000);
+    AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < keys.size(); i++)
+        rtree.insert(NonOverlappingInterval(keys[i], 5));
+    std::vector<int> lookups;
+    for(unsigned i = 0; i < keys.size(); i++)
+        lookups.push_back(i % 10 == 0 ? keys[i] : keys[i % 64]);
+    Find_Cache<AVL_Tree<NonOverlappingInterval> > cache(rtree);
+    unsigned found = 0;
+    QBENCHMARK {
+        for(unsigned i = 0; i < lookups.size(); i++)
+            found += cache.find(NonOverlappingInterval(lookups[i] + 1, 2)) != rtree.end();
+    }
+    QVERIFY(found % lookups.size() == 0);
+    QVERIFY(cache.hits() > cache.misses());
+}
+
+void AVL_Tree_Test::benchmarkFindContainingBatch()
+{
+    const std::vector<int> keys = shuffledKeys(100000);
+    AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < keys.size(); i++)
+        rtree.insert(NonOverlappingInterval(keys[i], 5));
+    std::vector<int> addresses;
+    for(unsigned i = 0; i < keys.size(); i++)
+        addresses.push_back(keys[i] + 1);
+    std::vector<AVL_Tree<NonOverlappingInterval>::const_iterator> found(addresses.size());
+    QBENCHMARK {
+        find_containing_batch(rtree, addresses.begin(), addresses.end(), found.begin());
+    }
+    QVERIFY(std::count(found.begin(), found.end(), rtree.end()) == 0);
+}
+
+void AVL_Tree_Test::benchmarkRemove()
+{
+    const std::vector<int> keys = shuffledKeys(100000);
+    AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < keys.size(); i++)
+        rtree.insert(NonOverlappingInterval(keys[i], 5));
+    QBENCHMARK_ONCE {
+        for(unsigned i = 0; i < keys.size(); i++)
+            rtree.remove(NonOverlappingInterval(keys[i] + 1, 2));
+    }
+    QVERIFY(rtree.empty());
+}
+
+void AVL_Tree_Test::benchmarkRemoveLazy()
+{
+    const std::vector<int> keys = shuffledKeys(100000);
+    Lazy_AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < keys.size(); i++)
+        rtree.insert(NonOverlappingInterval(keys[i], 5));
+    QBENCHMARK_ONCE {
+        for(unsigned i = 0; i < keys.size(); i++)
+            rtree.remove(NonOverlappingInterval(keys[i] + 1, 2));
+    }
+    QVERIFY(rtree.empty());
+}
+
+void AVL_Tree_Test::benchmarkFindCompact()
+{
+    const std::vector<int> keys = shuffledKeys(100000);
+    Compact_AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < keys.size(); i++)
+        rtree.insert(NonOverlappingInterval(keys[i], 5));
+    unsigned found = 0;
+    QBENCHMARK {
+        for(unsigned i = 0; i < keys.size(); i++)
+            found += rtree.find(NonOverlappingInterval(keys[i] + 1, 2)) != NULL;
+    }
+    QVERIFY(found % keys.size() == 0);
+}
+
+void AVL_Tree_Test::benchmarkFindFrozen()
+{
+    const std::vector<int> keys = shuffledKeys(100000);
+    AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < keys.size(); i++)
+        rtree.insert(NonOverlappingInterval(keys[i], 5));
+    const Frozen_Index<NonOverlappingInterval> index = freeze(rtree);
+    unsigned found = 0;
+    QBENCHMARK {
+        for(unsigned i = 0; i < keys.size(); i++)
+            found += index.find(NonOverlappingInterval(keys[i] + 1, 2)) != NULL;
+    }
+    QVERIFY(found % keys.size() == 0);
+}
+
+// Reservations of mixed lengths, most of them short, queried with short
+// windows: each query meets a handful of them.
+void AVL_Tree_Test::benchmarkOverlaps()
+{
+    const std::vector<int> keys = shuffledKeys(100000);
+    Interval_Tree tree;
+    for(unsigned i = 0; i < keys.size(); i++)
+        tree.insert(NonOverlappingInterval(keys[i], 1 + keys[i] % 7 * (keys[i] % 97 == 0 ? 2000 : 3)));
+    std::vector<NonOverlappingInterval> found;
+    QBENCHMARK {
+        found.clear();
+        for(unsigned i = 0; i < keys.size(); i += 10)
+            tree.overlaps(NonOverlappingInterval(keys[i], 4), std::back_inserter(found));
+    }
+    QVERIFY(found.size() >= keys.size() / 10);
+}
+
+void AVL_Tree_Test::benchmarkInsertBatch()
+{
+    AVL_Tree<NonOverlappingInterval> rtree;
+    for(unsigned i = 0; i < 100000; i++)
+        rtree.insert(NonOverlappingInterval(i*20, 5));
+    std::vector<NonOverlappingInterval> batch;
+    for(unsigned i = 0; i < 100000; i += 10)
+        batch.push_back(NonOverlappingInterval(i*20 + 10, 5));
+    std::vector<bool> inserted;
+    QBENCHMARK_ONCE {
+        rtree.insert_batch(batch.begin(), batch.end(), std::back_inserter(inserted));
+    }
+    QVERIFY(rtree.size() == 110000);
+}
+
+void AVL_Tree_Test::benchmarkUnion()
+{
+    std::vector<NonOverlappingInterval> even;
+    std::vector<NonOverlappingInterval> odd;
+    for(unsigned i = 0; i < 1000000; i += 2)
+    {
+        even.push_back(NonOverlappingInterval(i*10, 5));
+        odd.push_back(NonOverlappingInterval(i*10 + 10, 5));
+    }
+    AVL_Tree<NonOverlappingInterval> rtree;
+    AVL_Tree<NonOverlappingInterval> other;
+    rtree.assign(even.begin(), even.end());
+    other.assign(odd.begin(), odd.end());
+    QBENCHMARK_ONCE {
+        rtree.union_with(other);
+    }
+    QVERIFY(rtree.size() == 1000000);
+}
+
+void AVL_Tree_Test::benchmarkShardedThreadScaling()
+{
+    const unsigned operations = 1 << 16;
+    for(unsigned threads = 1; threads <= 64; threads *= 2)
+    {
+        Sharded_AVL_Tree<NonOverlappingInterval> rtree(0, 64*operations*10 - 1, 64);
+        std::vector<std::thread> writers;
+        QElapsedTimer timer;
+        timer.start();
+        for(unsigned w = 0; w < threads; w++)
+            writers.push_back(std::thread(writeRegion, std::ref(rtree), int(w*(64/threads)*operations*10), operations/threads));
+        for(unsigned w = 0; w < writers.size(); w++)
+            writers[w].join();
+        qDebug() << "threads:" << threads << "ns/op:" << double(timer.nsecsElapsed()) / (2*operations);
+        QVERIFY(rtree.size() == threads);
+    }
+}
 
 
 QTEST_APPLESS_MAIN(AVL_Tree_Test)